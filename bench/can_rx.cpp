@@ -0,0 +1,183 @@
+// CAN receive throughput of the read loops over an AF_UNIX SOCK_SEQPACKET socketpair, which
+// carries canfd_frames like a CAN_RAW socket does and needs no vcan interface:
+//   can_rx [frames per run]
+#include "can.hpp"
+#include "handler_allocator.hpp"
+
+#include <atomic>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/posix/stream_descriptor.hpp>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+
+using namespace asio::utils::can;
+
+// Counts every heap allocation of the process, the writer thread makes none while a run is timed
+static std::atomic<uint64_t> heap_allocations{0};
+
+void* operator new(std::size_t size) {
+    heap_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+    std::free(p);
+}
+
+namespace {
+
+struct Result {
+    double frames_per_second;
+    double cpu_ns_per_frame;  // Of the thread running the io_context
+    double heap_allocations_per_frame;
+    double recycled_allocations_per_frame;
+    uint64_t callbacks;
+};
+
+struct ReaderBase : std::enable_shared_from_this<ReaderBase> {
+    virtual ~ReaderBase() = default;
+};
+
+// The read loop as it was before the reused buffer: a recycled frame per read and a cast back from
+// the base's shared_ptr per completion. The old loop used async_read, which waits for a full
+// canfd_frame, async_read_some keeps this one correct for CAN_MTU frames
+class AllocatingReader : public ReaderBase {
+public:
+    AllocatingReader(boost::asio::io_context& io, int fd, Can::CanReadHandler&& handler)
+        : _stream(io, fd), _handler(std::move(handler)) {}
+
+    void read_next() {
+        auto frame = std::allocate_shared<canfd_frame>(asio::utils::RecyclingAllocator<canfd_frame>());
+        _stream.async_read_some(boost::asio::buffer(frame.get(), sizeof(canfd_frame)),
+                                asio::utils::with_recycling_allocator(
+                                    [self = shared_from_this(), frame](const boost::system::error_code& err, size_t) {
+                                        auto reader = std::dynamic_pointer_cast<AllocatingReader>(self);
+                                        if (!err) {
+                                            reader->_handler(*frame);
+                                            reader->read_next();
+                                        }
+                                    }));
+    }
+
+private:
+    boost::asio::posix::stream_descriptor _stream;
+    Can::CanReadHandler _handler;
+};
+
+double thread_cpu_ns() {
+    rusage usage = {};
+    getrusage(RUSAGE_THREAD, &usage);
+    return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1e9 +
+           (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * 1e3;
+}
+
+// PER_READ_FRAME is the AllocatingReader, READ_CALLBACK the register_read_callback loop reading
+// into a reused buffer and BATCH the recvmmsg one
+enum class Loop { PER_READ_FRAME, READ_CALLBACK, BATCH };
+
+Result run(Loop loop, size_t batch, int frames) {
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sv) < 0) {
+        std::perror("socketpair");
+        std::exit(1);
+    }
+    int buffer = 4 << 20;
+    setsockopt(sv[0], SOL_SOCKET, SO_SNDBUF, &buffer, sizeof(buffer));
+
+    boost::asio::io_context io;
+    std::shared_ptr<Can> can;
+    std::shared_ptr<AllocatingReader> reader;
+    int received  = 0;
+    Result result = {};
+    auto on_frame = [&](const canfd_frame&) {
+        if (++received == frames) {
+            io.stop();
+        }
+    };
+    if (loop == Loop::PER_READ_FRAME) {
+        reader = std::make_shared<AllocatingReader>(io, sv[1], [&](const canfd_frame& frame) {
+            result.callbacks++;
+            on_frame(frame);
+        });
+        reader->read_next();
+    } else if (loop == Loop::BATCH) {
+        can = Can::create(io, sv[1]);
+        can->register_batch_read_callback(
+            [&](std::span<const canfd_frame> batch_frames) {
+                result.callbacks++;
+                for (const auto& frame : batch_frames) {
+                    on_frame(frame);
+                }
+            },
+            batch);
+    } else {
+        can = Can::create(io, sv[1]);
+        can->register_read_callback([&](const canfd_frame& frame) {
+            result.callbacks++;
+            on_frame(frame);
+        });
+    }
+
+    std::thread writer([&]() {
+        canfd_frame frame = {};
+        frame.len         = CAN_MAX_DLEN;
+        for (int i = 0; i < frames; i++) {
+            frame.can_id = i & CAN_SFF_MASK;
+            if (write(sv[0], &frame, CAN_MTU) != CAN_MTU) {
+                std::perror("write");
+                std::exit(1);
+            }
+        }
+    });
+
+    auto start         = std::chrono::steady_clock::now();
+    double cpu         = thread_cpu_ns();
+    uint64_t allocated = heap_allocations.load(std::memory_order_relaxed);
+    uint64_t recycled  = asio::utils::handler_allocator_stats().recycled_allocations;
+    io.run();
+    allocated = heap_allocations.load(std::memory_order_relaxed) - allocated;
+    recycled  = asio::utils::handler_allocator_stats().recycled_allocations - recycled;
+    cpu       = thread_cpu_ns() - cpu;
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    writer.join();
+    close(sv[0]);
+
+    result.frames_per_second              = frames / elapsed.count();
+    result.cpu_ns_per_frame               = cpu / frames;
+    result.heap_allocations_per_frame     = static_cast<double>(allocated) / frames;
+    result.recycled_allocations_per_frame = static_cast<double>(recycled) / frames;
+    return result;
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    int frames = argc > 1 ? std::atoi(argv[1]) : 200000;
+
+    auto print = [](const std::string& name, const Result& result) {
+        std::printf("%-20s %10.0f frames/s %6.0f ns reader CPU/frame %5.2f heap %5.2f recycled allocations/frame "
+                    "%8lu callbacks\n",
+                    name.c_str(), result.frames_per_second, result.cpu_ns_per_frame, result.heap_allocations_per_frame,
+                    result.recycled_allocations_per_frame, result.callbacks);
+    };
+    print("per-read frame", run(Loop::PER_READ_FRAME, 0, frames));
+    print("read", run(Loop::READ_CALLBACK, 0, frames));
+    for (size_t batch : {1, 16, 64}) {
+        print("recvmmsg batch " + std::to_string(batch), run(Loop::BATCH, batch, frames));
+    }
+    return 0;
+}
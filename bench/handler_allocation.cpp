@@ -0,0 +1,57 @@
+// Runs a periodic Timer that sends a UDP datagram to itself on every tick and fails when the
+// handler allocator still goes to the heap once the loop is warmed up:
+//   handler_allocation [ticks]
+#include "handler_allocator.hpp"
+#include "timer.hpp"
+#include "udp_client.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+
+using namespace asio::utils;
+
+static constexpr int WARMUP_TICKS = 100;
+static constexpr uint16_t PORT    = 47311;
+
+int main(int argc, char* argv[]) {
+    int ticks = argc > 1 ? std::atoi(argv[1]) : 1000;
+    if (ticks <= WARMUP_TICKS) {
+        std::fprintf(stderr, "Usage: %s [ticks > %d]\n", argv[0], WARMUP_TICKS);
+        return 1;
+    }
+
+    boost::asio::io_context io;
+    auto udp = UdpClient::create(io, "127.0.0.1", PORT, PORT);
+
+    int received = 0;
+    udp->register_callback("bench", [&](std::vector<char>&, size_t) { received++; });
+
+    const char payload[] = "handler allocation";
+    int fired            = 0;
+    HandlerAllocatorStats warm;
+    TimerConfig config;
+    config.name                   = "bench";
+    config.start_interval_msec    = std::chrono::milliseconds(1);
+    config.periodic_interval_msec = std::chrono::milliseconds(1);
+    config.callback_fn            = [&]() {
+        if (++fired == WARMUP_TICKS) {
+            warm = handler_allocator_stats();
+        } else if (fired == ticks) {
+            io.stop();
+            return;
+        }
+        udp->async_send(payload, sizeof(payload));
+    };
+    auto timer = Timer::create(config, io);
+    timer->start();
+    io.run();
+
+    auto done = handler_allocator_stats();
+    std::printf("ticks %d datagrams %d after warm-up: heap %lu -> %lu recycled %lu -> %lu\n", fired, received,
+                warm.heap_allocations, done.heap_allocations, warm.recycled_allocations, done.recycled_allocations);
+    if (done.heap_allocations != warm.heap_allocations) {
+        std::fprintf(stderr, "Handler allocations still hit the heap after warm-up\n");
+        return 1;
+    }
+    return 0;
+}
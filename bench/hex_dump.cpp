@@ -0,0 +1,62 @@
+// Throughput of the scalar, SSSE3 and AVX2 hex_dump kernels for CAN, CAN FD and UDP sized
+// payloads. Kernels the CPU doesn't support are skipped, a kernel whose output differs from
+// the scalar one fails the run:
+//   hex_dump [megabytes per run]
+#include "string_util.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+using namespace asio::utils::stringUtil;
+
+static constexpr size_t PAYLOAD_SIZES[] = {8, 64, 1472};
+
+int main(int argc, char* argv[]) {
+    size_t total = (argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 64) << 20;
+
+    std::vector<uint8_t> data(PAYLOAD_SIZES[std::size(PAYLOAD_SIZES) - 1]);
+    std::mt19937 random(1);
+    for (auto& byte : data) {
+        byte = static_cast<uint8_t>(random());
+    }
+
+    auto kernels = detail::hex_kernels();
+    struct Candidate {
+        const char* name;
+        detail::HexKernel kernel;
+    } candidates[] = {{"scalar", kernels.scalar}, {"ssse3", kernels.ssse3}, {"avx2", kernels.avx2}};
+
+    std::vector<char> expected(data.size() * 3);
+    std::vector<char> out(data.size() * 3);
+    int ret = 0;
+    for (size_t size : PAYLOAD_SIZES) {
+        kernels.scalar(expected.data(), data.data(), size);
+        for (const auto& candidate : candidates) {
+            if (!candidate.kernel) {
+                std::printf("%6zu bytes %-6s not supported\n", size, candidate.name);
+                continue;
+            }
+            candidate.kernel(out.data(), data.data(), size);
+            if (std::memcmp(out.data(), expected.data(), size * 3)) {
+                std::fprintf(stderr, "%s output differs from scalar for %zu bytes\n", candidate.name, size);
+                ret = 1;
+                continue;
+            }
+
+            size_t calls = std::max<size_t>(total / size, 1);
+            auto start   = std::chrono::steady_clock::now();
+            for (size_t i = 0; i < calls; i++) {
+                candidate.kernel(out.data(), data.data(), size);
+                asm volatile("" : : "r"(out.data()) : "memory");
+            }
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+            std::printf("%6zu bytes %-6s %8.1f ns/call %8.2f GB/s\n", size, candidate.name,
+                        elapsed.count() * 1e9 / calls, calls * size / elapsed.count() / 1e9);
+        }
+    }
+    return ret;
+}
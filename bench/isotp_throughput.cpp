@@ -0,0 +1,102 @@
+// ISO-TP throughput between two IsoTp instances on the ends of an AF_UNIX SOCK_SEQPACKET
+// socketpair, standing in for a vcan interface. Each message is sent once the previous one
+// completed:
+//   isotp_throughput [seconds per run] [io_context threads]
+#include "isotp.hpp"
+
+#include <boost/asio/executor_work_guard.hpp>
+#include <boost/asio/io_context.hpp>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <sys/socket.h>
+#include <thread>
+#include <vector>
+
+using namespace asio::utils::can;
+
+namespace {
+
+constexpr IsoTpAddress TESTER = {0x7E0, 0x7E8};
+constexpr IsoTpAddress ECU    = {0x7E8, 0x7E0};
+
+void run(const char* name, const IsoTpConfig& config, size_t message_size, double seconds, int threads) {
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sv) < 0) {
+        std::perror("socketpair");
+        std::exit(1);
+    }
+    int buffer = 4 << 20;
+    for (int fd : sv) {
+        setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &buffer, sizeof(buffer));
+        setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &buffer, sizeof(buffer));
+    }
+
+    boost::asio::io_context io;
+    auto sender   = IsoTp::create(io, Can::create(io, sv[0]), config);
+    auto receiver = IsoTp::create(io, Can::create(io, sv[1]), config);
+
+    std::atomic<uint64_t> received{0};
+    std::atomic<bool> failed{false};
+    receiver->open_session(ECU, [&](std::span<const uint8_t> payload) {
+        if (payload.size() == message_size) {
+            received.fetch_add(1, std::memory_order_relaxed);
+        }
+    });
+    sender->open_session(TESTER, [](std::span<const uint8_t>) {});
+
+    std::vector<uint8_t> message(message_size, 0x5A);
+    std::atomic<bool> stopping{false};
+    std::function<void(const boost::system::error_code&)> send_next = [&](const boost::system::error_code& err) {
+        if (err) {
+            std::fprintf(stderr, "%s: send failed: %s\n", name, err.message().c_str());
+            failed = true;
+            return;
+        }
+        if (!stopping) {
+            sender->async_send(TESTER, message, [&](const boost::system::error_code& err) { send_next(err); });
+        }
+    };
+    send_next({});
+
+    auto work  = boost::asio::make_work_guard(io);
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> workers;
+    for (int i = 0; i < threads; i++) {
+        workers.emplace_back([&io]() { io.run(); });
+    }
+    std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+    stopping = true;
+    uint64_t count = received.load();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    io.stop();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+
+    size_t frame_payload = config.fd ? CANFD_MAX_DLEN - 1 : CAN_MAX_DLEN - 1;
+    std::printf("%-12s %6zu B messages %9.0f msgs/s %9.0f kB/s %9.0f frames/s%s\n", name, message_size,
+                count / elapsed.count(), count * message_size / elapsed.count() / 1000,
+                count * ((message_size + frame_payload - 1) / frame_payload) / elapsed.count(),
+                failed ? " (failed)" : "");
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    double seconds = argc > 1 ? std::atof(argv[1]) : 2;
+    int threads    = argc > 2 ? std::atoi(argv[2]) : 1;
+
+    IsoTpConfig classic;
+    IsoTpConfig classic_blocks;
+    classic_blocks.block_size = 8;
+    IsoTpConfig fd;
+    fd.fd = true;
+
+    run("classic", classic, 4095, seconds, threads);
+    run("classic bs 8", classic_blocks, 4095, seconds, threads);
+    run("fd", fd, 4095, seconds, threads);
+    return 0;
+}
@@ -0,0 +1,148 @@
+// Latency of Timer control calls (start, is_started, set_periodic_interval) made from other
+// threads while a periodic callback is running, against a timer built the way Timer used to be:
+// one recursive_mutex taken by every call and held across the callback.
+//   timer_contention [control threads] [callback time in us] [seconds per run]
+#include "timer.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <boost/asio/bind_executor.hpp>
+#include <boost/asio/executor_work_guard.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/asio/strand.hpp>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace asio::utils;
+using clk = std::chrono::steady_clock;
+
+namespace {
+
+class LockedTimer : public std::enable_shared_from_this<LockedTimer> {
+public:
+    LockedTimer(boost::asio::io_context& io, std::chrono::nanoseconds interval, std::function<void()> callback)
+        : _timer(io), _strand(boost::asio::make_strand(io)), _interval(interval), _callback(std::move(callback)) {}
+
+    void start() {
+        std::lock_guard<std::recursive_mutex> lock(_mutex);
+        if (!_started) {
+            _started = true;
+            async_wait();
+        }
+    }
+
+    void stop() {
+        std::lock_guard<std::recursive_mutex> lock(_mutex);
+        _started = false;
+        _timer.cancel();
+    }
+
+    bool is_started() {
+        std::lock_guard<std::recursive_mutex> lock(_mutex);
+        return _started;
+    }
+
+    void set_periodic_interval(std::chrono::nanoseconds interval) {
+        std::lock_guard<std::recursive_mutex> lock(_mutex);
+        _interval = interval;
+    }
+
+private:
+    void async_wait() {
+        _timer.expires_after(_interval);
+        _timer.async_wait(boost::asio::bind_executor(
+            _strand, [self = shared_from_this()](const boost::system::error_code& ec) { self->timer_callback(ec); }));
+    }
+
+    void timer_callback(const boost::system::error_code& ec) {
+        std::lock_guard<std::recursive_mutex> lock(_mutex);
+        if (ec || !_started) {
+            return;
+        }
+        _callback();
+        async_wait();
+    }
+
+    std::recursive_mutex _mutex;
+    boost::asio::steady_timer _timer;
+    boost::asio::strand<boost::asio::io_context::executor_type> _strand;
+    std::chrono::nanoseconds _interval;
+    std::function<void()> _callback;
+    bool _started = false;
+};
+
+template <typename T>
+void run(const char* name, std::shared_ptr<T> timer, boost::asio::io_context& io, std::atomic<uint64_t>& callbacks,
+         int threads, double seconds) {
+    auto guard = boost::asio::make_work_guard(io);
+    std::thread io_thread([&]() { io.run(); });
+    timer->start();
+
+    auto end = clk::now() + std::chrono::duration_cast<clk::duration>(std::chrono::duration<double>(seconds));
+    std::vector<std::vector<int64_t>> samples(threads);
+    std::vector<std::thread> controllers;
+    for (int i = 0; i < threads; i++) {
+        controllers.emplace_back([&, i]() {
+            while (clk::now() < end) {
+                auto start = clk::now();
+                timer->start();
+                timer->is_started();
+                timer->set_periodic_interval(std::chrono::milliseconds(1));
+                samples[i].push_back((clk::now() - start).count());
+                std::this_thread::sleep_for(std::chrono::microseconds(200));
+            }
+        });
+    }
+    for (auto& controller : controllers) {
+        controller.join();
+    }
+    timer->stop();
+    guard.reset();
+    io_thread.join();
+
+    std::vector<int64_t> all;
+    for (auto& s : samples) {
+        all.insert(all.end(), s.begin(), s.end());
+    }
+    std::sort(all.begin(), all.end());
+    int64_t total = 0;
+    for (auto ns : all) {
+        total += ns;
+    }
+    size_t count = std::max<size_t>(all.size(), 1);
+    std::printf("%-14s %7zu control calls  mean %9.1fus  p99 %9.1fus  max %9.1fus  callbacks %lu\n", name, all.size(),
+                total / 1000.0 / count, all.empty() ? 0.0 : all[all.size() * 99 / 100] / 1000.0,
+                all.empty() ? 0.0 : all.back() / 1000.0, callbacks.load());
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    int threads = argc > 1 ? std::atoi(argv[1]) : 2;
+    std::chrono::microseconds work(argc > 2 ? std::atoi(argv[2]) : 500);
+    double seconds = argc > 3 ? std::atof(argv[3]) : 2;
+
+    // The callback takes work out of each 1ms period
+    std::atomic<uint64_t> callbacks{0};
+    auto callback = [&]() {
+        callbacks++;
+        std::this_thread::sleep_for(work);
+    };
+    {
+        boost::asio::io_context io;
+        run("recursive_mutex", std::make_shared<LockedTimer>(io, std::chrono::milliseconds(1), callback), io,
+            callbacks, threads, seconds);
+    }
+    callbacks = 0;
+    {
+        boost::asio::io_context io;
+        TimerConfig config;
+        config.start_interval = config.periodic_interval = std::chrono::milliseconds(1);
+        config.callback_fn    = callback;
+        run("Timer", Timer::create(config, io), io, callbacks, threads, seconds);
+    }
+    return 0;
+}
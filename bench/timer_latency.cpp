@@ -0,0 +1,60 @@
+// Callback lateness of a periodic Timer expiring through its own steady_timer, a timerfd
+// (high_resolution) or, for periods of at least a wheel tick, the TimerService:
+//   timer_latency [period in us] [seconds per run]
+#include "timer.hpp"
+#include "timer_service.hpp"
+
+#include <algorithm>
+#include <boost/asio/steady_timer.hpp>
+#include <cstdio>
+#include <cstdlib>
+
+using namespace asio::utils;
+
+namespace {
+
+void run(const char* name, TimerConfig config, std::chrono::microseconds period, double seconds) {
+    boost::asio::io_context io;
+    config.name           = name;
+    config.periodic_mode  = PeriodicMode::CATCH_UP;
+    config.start_interval = config.periodic_interval = period;
+    config.callback_fn    = []() {};
+    auto timer            = Timer::create(config, io);
+    timer->start();
+
+    boost::asio::steady_timer end(io);
+    end.expires_after(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::duration<double>(seconds)));
+    end.async_wait([&](const boost::system::error_code&) { timer->stop(); });
+    io.run();
+
+    auto stats      = timer->stats();
+    auto usec       = [](std::chrono::nanoseconds ns) { return ns.count() / 1000.0; };
+    uint64_t count  = std::max<uint64_t>(stats.expirations, 1);
+    uint64_t within = 0;  // Less than 64us late
+    for (size_t i = 0; i <= 6; i++) {
+        within += stats.jitter_histogram[i];
+    }
+    std::printf("%-14s %8lu expirations  mean late %8.1fus  max late %8.1fus  <64us late %5.1f%%\n", name,
+                stats.expirations, usec(stats.total_lateness) / count, usec(stats.max_lateness),
+                100.0 * within / count);
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    std::chrono::microseconds period(argc > 1 ? std::atoi(argv[1]) : 250);
+    double seconds = argc > 2 ? std::atof(argv[2]) : 2;
+
+    TimerConfig steady;
+    TimerConfig timerfd;
+    timerfd.high_resolution = true;
+    TimerConfig wheel;
+    wheel.use_timer_service = true;
+
+    run("steady_timer", steady, period, seconds);
+    run("timerfd", timerfd, period, seconds);
+    if (period >= TimerService::TICK) {
+        run("timer service", wheel, period, seconds);
+    }
+    return 0;
+}
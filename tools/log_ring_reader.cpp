@@ -0,0 +1,76 @@
+// Prints the content of a MmapRingSink file in order, oldest record first:
+//   log_ring_reader <file>
+#include "log_sink.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+using asio::logger::MmapRingHeader;
+using asio::logger::MmapRingSlot;
+
+int main(int argc, char* argv[]) {
+    if (argc != 2) {
+        std::fprintf(stderr, "Usage: %s <log ring file>\n", argv[0]);
+        return 1;
+    }
+
+    int fd = open(argv[1], O_RDONLY | O_CLOEXEC);
+    struct stat st = {};
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        std::fprintf(stderr, "Can't open %s: %s\n", argv[1], std::strerror(errno));
+        return 1;
+    }
+
+    size_t size = st.st_size;
+    if (size < MmapRingHeader::SIZE) {
+        std::fprintf(stderr, "%s is not a log ring file\n", argv[1]);
+        return 1;
+    }
+    void* map = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        std::fprintf(stderr, "Can't map %s: %s\n", argv[1], std::strerror(errno));
+        return 1;
+    }
+
+    auto* base   = static_cast<const std::byte*>(map);
+    auto* header = reinterpret_cast<const MmapRingHeader*>(base);
+    if (header->magic != MmapRingHeader::MAGIC || header->version != MmapRingHeader::VERSION ||
+        header->slot_size <= sizeof(MmapRingSlot) ||
+        MmapRingHeader::SIZE + header->slot_count * header->slot_size > size) {
+        std::fprintf(stderr, "%s is not a log ring file or has an unsupported version\n", argv[1]);
+        return 1;
+    }
+
+    std::vector<const MmapRingSlot*> slots;
+    size_t text_size = header->slot_size - sizeof(MmapRingSlot);
+    for (uint64_t i = 0; i < header->slot_count; i++) {
+        auto* slot = reinterpret_cast<const MmapRingSlot*>(base + MmapRingHeader::SIZE + i * header->slot_size);
+        if (slot->seq != 0 && slot->len <= text_size) {
+            slots.push_back(slot);
+        }
+    }
+    std::sort(slots.begin(), slots.end(), [](auto* a, auto* b) { return a->seq < b->seq; });
+
+    // The oldest slots may hold the tail of a record whose start was already overwritten
+    auto first = std::find_if(slots.begin(), slots.end(), [](auto* slot) { return slot->flags & MmapRingSlot::FIRST; });
+    uint64_t expected = first != slots.end() ? (*first)->seq : 0;
+    for (auto it = first; it != slots.end(); ++it) {
+        const MmapRingSlot* slot = *it;
+        if (slot->seq != expected) {
+            std::printf("\n--- %lu slots lost ---\n", static_cast<unsigned long>(slot->seq - expected));
+        }
+        std::fwrite(slot + 1, 1, slot->len, stdout);
+        expected = slot->seq + 1;
+    }
+
+    munmap(map, size);
+    return 0;
+}
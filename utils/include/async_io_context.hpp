@@ -1,30 +1,129 @@
 #ifndef _UTILS_ASYNC_IO_CONTEXT_HPP_
 #define _UTILS_ASYNC_IO_CONTEXT_HPP_
 
+#include <atomic>
+#include <utility>  // Boost 1.74 awaitable.hpp uses std::exchange without including it
 #include <boost/asio.hpp>
+#include <chrono>
+#include <condition_variable>
+#include <list>
 #include <memory>
+#include <mutex>
 #include <thread>
 #include <vector>
 
 namespace asio::utils {
 
+struct AsyncIoContextConfig;
+
+enum class IoBackend : uint8_t {
+    AUTO,      // Whatever the library was built with
+    EPOLL,     // Reactor on epoll readiness, one syscall per operation
+    IO_URING,  // Operations submitted through io_uring (ASIO_UTILS_IO_URING build)
+};
+
 class AsyncIoContext {
 public:
+    static const int THREADPOOL_MIN_SIZE = 16;
+    static const int THREADPOOL_MAX_SIZE = 128;
+
     AsyncIoContext(int pool_size = THREADPOOL_MIN_SIZE);
+    explicit AsyncIoContext(const AsyncIoContextConfig& config);
     AsyncIoContext(const AsyncIoContext& rhs) = delete;
     AsyncIoContext(const AsyncIoContext&& rhs) = delete;
     virtual ~AsyncIoContext();
 
+    // In sharded mode every call hands out the next shard in round-robin order
     boost::asio::io_context& io_ctx();
 
+    // Returns the shard selected by key (key % shard_count()), so objects created
+    // with the same key always live on the same thread
+    boost::asio::io_context& io_ctx(std::size_t shard);
+
+    std::size_t shard_count() const;
+
+    // Number of worker threads currently running
+    int thread_count() const;
+
+    // Backend the io_contexts run on. It is selected at build time, so the same
+    // value is returned for every instance
+    static IoBackend backend();
+
 private:
-    static const int THREADPOOL_MIN_SIZE = 16;
-    static const int THREADPOOL_MAX_SIZE = 128;
+    struct Shard {
+        explicit Shard(int concurrency_hint);
+
+        boost::asio::io_context context;
+        boost::asio::executor_work_guard<boost::asio::io_context::executor_type> work_guard;
+    };
 
-    boost::asio::io_context _async_context;
-    boost::asio::executor_work_guard<boost::asio::io_context::executor_type> _work_guard;
+    struct ElasticPool {
+        int min_threads;
+        int max_threads;
+        std::chrono::microseconds grow_latency;
+        std::chrono::milliseconds idle_timeout;
+        std::chrono::milliseconds monitor_interval;
+        std::vector<int> cpu_cores;
+
+        std::mutex mutex;
+        std::condition_variable monitor_cv;
+        bool stopping = false;
+        int spawned   = 0;
+        std::list<std::thread> threads;
+        std::vector<std::thread::id> exited;
+        std::atomic<int> active{0};
+
+        std::atomic<bool> probe_pending{false};
+        std::chrono::steady_clock::time_point probe_posted;
+        std::atomic<int64_t> probe_latency_usec{0};
+        std::thread monitor;
+    };
+
+    std::thread make_thread(Shard& shard, int thread_idx, int cpu);
+    void run_fixed(Shard& shard, int thread_idx);
+    void run_busy_poll(Shard& shard, int thread_idx);
+    void run_elastic(Shard& shard, int thread_idx);
+    bool try_retire();
+
+    void spawn_elastic_thread();
+    void monitor_elastic_pool();
+    void reap_exited_threads();
+
+    std::vector<std::unique_ptr<Shard>> _shards;
     std::vector<std::thread> _thread_pool;
+    std::unique_ptr<ElasticPool> _elastic;
+    std::chrono::microseconds _busy_poll_budget{0};
+    std::atomic<std::size_t> _next_shard{0};
+};
+
+struct AsyncIoContextConfig {
+    // Number of threads. In sharded mode this is also the number of io_contexts,
+    // in elastic mode it is the upper bound the pool may grow to
+    int pool_size = AsyncIoContext::THREADPOOL_MIN_SIZE;
+
+    // Backend the caller expects. A mismatch with backend() fails construction instead of
+    // silently running a benchmark or deployment on the wrong one
+    IoBackend backend = IoBackend::AUTO;
+
+    // Give every thread its own io_context instead of sharing a single one
+    bool sharded = false;
+
+    // Thread i is pinned to cpu_cores[i % cpu_cores.size()], empty disables pinning
+    std::vector<int> cpu_cores;
+
+    // Worker threads spin on poll() and only block in the reactor after busy_poll_budget
+    // passed without any handler being ready. Costs a core per thread, best combined with
+    // sharded mode and cpu_cores. Zero disables busy polling, ignored for elastic pools
+    std::chrono::microseconds busy_poll_budget = std::chrono::microseconds(0);
+
+    // Elastic pool (shared io_context only): start with min_threads, add a thread whenever
+    // the handler queue latency exceeds grow_latency and retire threads idle for idle_timeout
+    bool elastic                           = false;
+    int min_threads                        = 1;
+    std::chrono::microseconds grow_latency = std::chrono::milliseconds(1);
+    std::chrono::milliseconds idle_timeout = std::chrono::seconds(30);
+    std::chrono::milliseconds monitor_interval = std::chrono::milliseconds(50);
 };
 
-}  
-#endif 
+}
+#endif
@@ -1,11 +1,17 @@
 #ifndef _UTILS_CAN_HPP_
 #define _UTILS_CAN_HPP_
 
+#include "priority_scheduler.hpp"
+#include "rx_timestamp.hpp"
+#include <utility>  // Boost 1.74 awaitable.hpp uses std::exchange without including it
+#include <boost/asio/awaitable.hpp>
 #include <boost/asio/io_context.hpp>
 #include <boost/asio/posix/stream_descriptor.hpp>
+#include <chrono>
 #include <functional>
 #include <linux/can.h>
 #include <memory>
+#include <span>
 #include <string>
 
 namespace asio::utils::can {
@@ -14,16 +20,82 @@ class Can : public std::enable_shared_from_this<Can> {
 public:
     using CanReadHandler = std::function<void(const canfd_frame&)>;
     using CanSendHandler = std::function<void(const boost::system::error_code& err)>;
+    // Frames are only valid for the duration of the call
+    using CanBatchReadHandler = std::function<void(std::span<const canfd_frame> frames)>;
+    using CanTimestampedReadHandler = std::function<void(const canfd_frame& frame, const RxTimestamp& timestamp)>;
+    using CanTxHighWaterHandler = std::function<void(bool above)>;
+    using SubscriptionId = uint64_t;
 
     static std::shared_ptr<Can> create(boost::asio::io_context& io_ctx, const std::string& can_device_name);
 
     static std::shared_ptr<Can> create(boost::asio::io_context& io_ctx, int socket_fd);
 
+    // Copies the frame into the transmit queue, frames go out in order, batched with sendmmsg.
+    // The handler runs once the kernel took the frame or it failed. Safe to call from any thread
     virtual void async_send(const canfd_frame& frame, const CanSendHandler& handler) = 0;
 
+    // Frames queued by async_send and not handed to the kernel yet
+    virtual size_t tx_queue_depth() const = 0;
+
+    // handler(true) runs when the transmit queue reaches mark frames, handler(false) once it
+    // drained to half of that again. Both are posted to the executor in the order they happened.
+    // A mark of 0 disables it
+    virtual void set_tx_high_water_mark(size_t mark, CanTxHighWaterHandler&& handler) = 0;
+
     virtual void async_read(CanReadHandler&& can_read_handler) = 0;
 
     virtual void register_read_callback(CanReadHandler&& can_read_handler) = 0;
+
+    // Drains up to max_batch frames per readiness event with one recvmmsg call and hands them
+    // over together. Replaces a callback registered before. ENETDOWN, ENOBUFS and ENOMEM keep the
+    // loop running and retry with a backoff of up to a second, other errors end it
+    virtual void register_batch_read_callback(CanBatchReadHandler&& can_batch_read_handler,
+                                              size_t max_batch = 64) = 0;
+
+    // Batched read loop calling handler for every frame with its kernel receive timestamp, zero
+    // until enable_rx_timestamps(). Replaces a callback registered before
+    virtual void register_timestamped_read_callback(CanTimestampedReadHandler&& handler, size_t max_batch = 64) = 0;
+
+    // Opt-in SO_TIMESTAMPNS, or SO_TIMESTAMPING with hardware stamps. Only the batched read
+    // loops see the timestamps. Returns 0 or errno
+    virtual int enable_rx_timestamps(bool hardware = false) = 0;
+
+    // Time from the kernel's software timestamp to the read callback, for frames of the batched
+    // read loops. Safe to call from any thread
+    virtual RxLatencyStats rx_latency_stats() const = 0;
+
+    virtual void reset_rx_latency_stats() = 0;
+
+    // Kernel side filtering with CAN_RAW_FILTER, frames matching none of the filters are dropped
+    // before they're copied to user space. An empty set drops every frame. Returns 0 or errno
+    virtual int set_filters(std::span<const can_filter> filters) = 0;
+
+    // Error frame classes (CAN_ERR_* bits) to deliver, none by default. Returns 0 or errno
+    virtual int set_error_filter(can_err_mask_t mask) = 0;
+
+    // Calls handler for frames of the read loop whose ID matches can_id under mask, after the
+    // registered read callback. CAN_EFF_FLAG in can_id subscribes to 29 bit IDs. Starts the
+    // register_read_callback loop without a callback when no read loop runs yet. Safe to call
+    // from any thread and from a subscription handler, handlers run on the read loop's thread
+    virtual SubscriptionId subscribe(canid_t can_id, CanReadHandler&& handler, canid_t mask = CAN_EFF_MASK) = 0;
+
+    // Called from another thread it waits for a running dispatch, the handler isn't called
+    // once it returned
+    virtual void unsubscribe(SubscriptionId id) = 0;
+
+    // Reads the next classic or FD frame, throws boost::system::system_error on failure.
+    // Not to be mixed with register_read_callback on the same instance
+    virtual boost::asio::awaitable<canfd_frame> async_read_frame() = 0;
+
+    virtual boost::asio::awaitable<void> async_send_frame(const canfd_frame& frame) = 0;
+
+    // Sets SO_BUSY_POLL on the socket, returns 0 or errno
+    virtual int set_busy_poll(std::chrono::microseconds budget) = 0;
+
+    // Completion handlers of operations started afterwards run through the io_context's
+    // PriorityScheduler at this level. Set it before registering the read callback
+    virtual void set_priority(HandlerPriority priority) = 0;
+
     virtual ~Can()                                                   = default;
 
     Can& operator=(const Can& other) = delete;
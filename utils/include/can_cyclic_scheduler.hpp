@@ -0,0 +1,53 @@
+#ifndef _UTILS_CAN_CYCLIC_SCHEDULER_HPP_
+#define _UTILS_CAN_CYCLIC_SCHEDULER_HPP_
+
+#include <boost/asio/io_context.hpp>
+#include <chrono>
+#include <functional>
+#include <linux/can.h>
+#include <memory>
+#include <string>
+
+namespace asio::utils::can {
+
+/**
+ * Cyclic CAN traffic handed to the kernel's broadcast manager (CAN_BCM).
+ *
+ * The kernel sends cyclic frames from its own hrtimers and watches received IDs for content
+ * changes and timeouts, so user space only wakes up for payload updates and events. Frames
+ * longer than CAN_MAX_DLEN are set up as CAN FD jobs.
+ */
+class CanCyclicScheduler {
+public:
+    using RxChangeHandler  = std::function<void(const canfd_frame& frame)>;
+    using RxTimeoutHandler = std::function<void(canid_t can_id)>;
+
+    static std::shared_ptr<CanCyclicScheduler> create(boost::asio::io_context& io_ctx,
+                                                      const std::string& can_device_name);
+
+    // Takes a CAN_BCM socket already connected to the interface
+    static std::shared_ptr<CanCyclicScheduler> create(boost::asio::io_context& io_ctx, int socket_fd);
+
+    // Sends frame every interval until stop_cyclic(). Calling it again for the same ID restarts
+    // the job with the new interval and payload. Returns 0 or errno
+    virtual int start_cyclic(const canfd_frame& frame, std::chrono::microseconds interval) = 0;
+
+    // Replaces the payload of a running job, it goes out with the next cycle without
+    // disturbing the timing. Returns 0 or errno
+    virtual int update_payload(const canfd_frame& frame) = 0;
+
+    virtual int stop_cyclic(canid_t can_id) = 0;
+
+    // on_change runs for the first frame of can_id and whenever its payload or length changes,
+    // on_timeout when no frame arrived for timeout (zero disables it). Returns 0 or errno
+    virtual int watch(canid_t can_id, std::chrono::microseconds timeout, RxChangeHandler&& on_change,
+                      RxTimeoutHandler&& on_timeout, bool fd_frames = false) = 0;
+
+    virtual int unwatch(canid_t can_id) = 0;
+
+    virtual ~CanCyclicScheduler() = default;
+};
+
+}
+
+#endif
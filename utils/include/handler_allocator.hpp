@@ -0,0 +1,100 @@
+#ifndef _UTILS_HANDLER_ALLOCATOR_HPP_
+#define _UTILS_HANDLER_ALLOCATOR_HPP_
+
+#include <boost/asio/associated_allocator.hpp>
+#include <boost/asio/associated_executor.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+
+namespace asio::utils {
+
+struct HandlerAllocatorStats {
+    uint64_t heap_allocations     = 0;  // Blocks that had to come from operator new
+    uint64_t recycled_allocations = 0;  // Blocks served from a thread's free list
+};
+
+// Totals over all threads, including threads that already exited. A steady state
+// receive or timer path shows up as recycled_allocations only
+HandlerAllocatorStats handler_allocator_stats();
+
+namespace detail {
+void* allocate_handler_memory(std::size_t size);
+void deallocate_handler_memory(void* pointer, std::size_t size) noexcept;
+}
+
+/**
+ * Allocator backed by per-thread free lists of a few size classes. Blocks released on any
+ * thread are kept for reuse by that thread, so async operations that are restarted from
+ * their own completion handler stop hitting the heap after the first round.
+ */
+template <typename T>
+class RecyclingAllocator {
+public:
+    using value_type = T;
+
+    RecyclingAllocator() noexcept = default;
+
+    template <typename U>
+    RecyclingAllocator(const RecyclingAllocator<U>&) noexcept {}
+
+    T* allocate(std::size_t n) { return static_cast<T*>(detail::allocate_handler_memory(n * sizeof(T))); }
+
+    void deallocate(T* pointer, std::size_t n) noexcept { detail::deallocate_handler_memory(pointer, n * sizeof(T)); }
+
+    template <typename U>
+    bool operator==(const RecyclingAllocator<U>&) const noexcept {
+        return true;
+    }
+
+    template <typename U>
+    bool operator!=(const RecyclingAllocator<U>&) const noexcept {
+        return false;
+    }
+};
+
+// Completion handler wrapper that makes asio allocate the operation state through
+// RecyclingAllocator. The associated executor of the wrapped handler is preserved
+template <typename Handler>
+class RecyclingHandler {
+public:
+    using allocator_type = RecyclingAllocator<void>;
+
+    template <typename H>
+    explicit RecyclingHandler(H&& handler) : _handler(std::forward<H>(handler)) {}
+
+    allocator_type get_allocator() const noexcept { return allocator_type(); }
+
+    template <typename... Args>
+    void operator()(Args&&... args) {
+        _handler(std::forward<Args>(args)...);
+    }
+
+    const Handler& handler() const noexcept { return _handler; }
+
+private:
+    Handler _handler;
+};
+
+template <typename Handler>
+RecyclingHandler<std::decay_t<Handler>> with_recycling_allocator(Handler&& handler) {
+    return RecyclingHandler<std::decay_t<Handler>>(std::forward<Handler>(handler));
+}
+
+}
+
+namespace boost::asio {
+
+template <typename Handler, typename Executor>
+struct associated_executor<::asio::utils::RecyclingHandler<Handler>, Executor> {
+    using type = typename associated_executor<Handler, Executor>::type;
+
+    static type get(const ::asio::utils::RecyclingHandler<Handler>& h, const Executor& ex = Executor()) noexcept {
+        return associated_executor<Handler, Executor>::get(h.handler(), ex);
+    }
+};
+
+}
+
+#endif
@@ -0,0 +1,81 @@
+#ifndef _UTILS_ISOTP_HPP_
+#define _UTILS_ISOTP_HPP_
+
+#include "can.hpp"
+#include <boost/asio/io_context.hpp>
+#include <boost/system/error_code.hpp>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <span>
+
+namespace asio::utils::can {
+
+// Normal addressing, CAN_EFF_FLAG marks 29 bit IDs
+struct IsoTpAddress {
+    canid_t tx_id;
+    canid_t rx_id;
+};
+
+struct IsoTpConfig {
+    // Flow control sent to the peer: frames per block (0 = all of them) and minimum gap between
+    // them, rounded up to what ISO 15765-2 can encode (100us steps below 1ms, 1ms steps to 127ms)
+    uint8_t block_size = 0;
+    std::chrono::microseconds st_min{0};
+
+    // Send CAN FD frames of up to 64 bytes, received frames are accepted in either format
+    bool fd             = false;
+    bool bitrate_switch = false;
+
+    // Pad frames to 8 bytes, FD frames are always padded to the next valid length
+    bool pad_frames      = true;
+    uint8_t padding_byte = 0xCC;
+
+    // N_Bs and N_Cr: how long to wait for a flow control frame and for the next consecutive frame
+    std::chrono::milliseconds timeout{1000};
+    // Flow control WAIT frames accepted in a row before the transfer fails (N_WFTmax)
+    unsigned max_wait_frames = 10;
+
+    // Longer first frames are answered with an overflow flow control
+    size_t max_message_size = 4095;
+    // Reassembly and transmit buffers kept around for reuse
+    size_t buffer_pool_size = 8;
+};
+
+/**
+ * ISO-TP (ISO 15765-2) segmentation and reassembly on top of a Can instance.
+ *
+ * Every session is an address pair with its own receive handler. Received frames come in through
+ * Can::subscribe, so the Can read loop must deliver the rx IDs. Messages of a session are sent
+ * one after the other, consecutive frames with no STmin are queued in one go and leave in
+ * sendmmsg batches.
+ *
+ * Each instance runs its frames, timers and handlers on a strand of its own, so the io_context
+ * may have several threads. The public calls are safe from any thread.
+ */
+class IsoTp {
+public:
+    // payload is only valid for the duration of the call
+    using ReceiveHandler = std::function<void(std::span<const uint8_t> payload)>;
+    using SendHandler    = std::function<void(const boost::system::error_code& err)>;
+
+    static std::shared_ptr<IsoTp> create(boost::asio::io_context& io_ctx, std::shared_ptr<Can> can,
+                                         const IsoTpConfig& config = {});
+
+    // Returns 0, EEXIST for a known address pair or EADDRINUSE when another session receives on rx_id
+    virtual int open_session(const IsoTpAddress& address, ReceiveHandler&& handler) = 0;
+
+    // Fails pending sends of the session with operation_aborted
+    virtual int close_session(const IsoTpAddress& address) = 0;
+
+    // Copies data and queues it on the session. handler runs once the last frame was handed to the
+    // kernel, or with timed_out, message_size (peer overflow), protocol_error or a Can error
+    virtual void async_send(const IsoTpAddress& address, std::span<const uint8_t> data, SendHandler&& handler) = 0;
+
+    virtual ~IsoTp() = default;
+};
+
+}
+
+#endif
@@ -0,0 +1,116 @@
+#ifndef _UTILS_LOG_DEFERRED_HPP_
+#define _UTILS_LOG_DEFERRED_HPP_
+
+#include "logger.hpp"
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+
+/**
+ * Deferred formatting for the LOG_* macros (ASIO_UTILS_DEFERRED_LOGGING). The calling thread
+ * copies the format string pointer and the encoded arguments into its ring buffer, the
+ * backend thread runs fmt. Arithmetic and enum arguments are copied as they are, strings
+ * (including const char*) are copied by value and anything else is formatted to a string up
+ * front, as a trivially copyable type may still point to memory the caller owns.
+ */
+namespace asio::logger::detail {
+
+using DeferredFormatter = void (*)(std::string& out, std::string_view format, const std::byte* args);
+
+// Room for args_size bytes of encoded arguments or nullptr if the record is dropped.
+// A non null result has to be followed by commit_deferred() on the same thread
+std::byte* begin_deferred(LogLevel level, CategoryType categories, const char* filename, unsigned int line_no,
+                          std::string_view format, DeferredFormatter formatter, size_t args_size);
+
+void commit_deferred();
+
+template <typename T>
+constexpr bool is_deferred_string = std::is_same_v<T, std::string_view> || std::is_same_v<T, std::string>;
+
+template <typename T>
+auto deferred_value(const T& arg) {
+    if constexpr (std::is_convertible_v<const T&, std::string_view>) {
+        if constexpr (std::is_pointer_v<T>) {
+            if (!arg) {
+                return std::string_view("(null)");
+            }
+        }
+        return std::string_view(arg);
+    } else if constexpr (std::is_arithmetic_v<T> || std::is_enum_v<T>) {
+        return arg;
+    } else {
+        return fmt::format("{}", arg);
+    }
+}
+
+template <typename T>
+size_t encoded_size(const T& value) {
+    if constexpr (is_deferred_string<T>) {
+        return sizeof(uint32_t) + value.size();
+    } else {
+        return sizeof(T);
+    }
+}
+
+template <typename T>
+std::byte* encode(std::byte* p, const T& value) {
+    if constexpr (is_deferred_string<T>) {
+        auto len = static_cast<uint32_t>(value.size());
+        std::memcpy(p, &len, sizeof(len));
+        std::memcpy(p + sizeof(len), value.data(), len);
+        return p + sizeof(len) + len;
+    } else {
+        std::memcpy(p, &value, sizeof(T));
+        return p + sizeof(T);
+    }
+}
+
+template <typename T>
+auto decode(const std::byte*& p) {
+    if constexpr (is_deferred_string<T>) {
+        uint32_t len;
+        std::memcpy(&len, p, sizeof(len));
+        std::string_view value(reinterpret_cast<const char*>(p + sizeof(len)), len);
+        p += sizeof(len) + len;
+        return value;
+    } else {
+        T value;
+        std::memcpy(&value, p, sizeof(T));
+        p += sizeof(T);
+        return value;
+    }
+}
+
+template <typename... Args>
+void format_deferred(std::string& out, std::string_view format, const std::byte* p) {
+    // Braced initialisation decodes the arguments left to right
+    std::tuple<decltype(decode<Args>(p))...> values{decode<Args>(p)...};
+    std::apply([&](const auto&... v) { fmt::vformat_to(std::back_inserter(out), format, fmt::make_format_args(v...)); },
+               values);
+}
+
+template <typename... Args>
+void write_deferred(LogLevel level, CategoryType categories, const char* filename, unsigned int line_no,
+                    std::string_view format, const Args&... args) {
+    size_t size = (size_t(0) + ... + encoded_size(args));
+    std::byte* p = begin_deferred(level, categories, filename, line_no, format, &format_deferred<Args...>, size);
+    if (p) {
+        ((p = encode(p, args)), ...);
+        commit_deferred();
+    }
+}
+
+template <typename... Args>
+void log_deferred(LogLevel level, CategoryType categories, const char* filename, unsigned int line_no,
+                  fmt::format_string<Args...> format, Args&&... args) {
+    fmt::string_view fmt_view = format;
+    write_deferred(level, categories, filename, line_no, std::string_view(fmt_view.data(), fmt_view.size()),
+                   deferred_value(args)...);
+}
+
+}
+
+#endif
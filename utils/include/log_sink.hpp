@@ -0,0 +1,123 @@
+#ifndef _UTILS_LOG_SINK_HPP_
+#define _UTILS_LOG_SINK_HPP_
+
+#include "logger.hpp"
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <string_view>
+
+namespace asio::logger {
+
+struct LogRecord {
+    LogLevel level;
+    CategoryType categories;
+    const char* filename;
+    unsigned int line_no;
+    uint64_t thread_id;
+    std::chrono::system_clock::time_point timestamp;
+    std::string_view message;
+};
+
+/**
+ * Destination of formatted log records. Sinks are only called from the logger's
+ * backend thread, so implementations don't need to be thread safe.
+ */
+class LogSink {
+public:
+    virtual ~LogSink() = default;
+
+    virtual void write(const LogRecord& record) = 0;
+
+    virtual void flush() {}
+};
+
+const char* level_name(LogLevel level);
+
+// "2024-01-31 12:00:00.123456 [info] [tid] file.cpp:42 message\n"
+void format_record(std::string& out, const LogRecord& record);
+
+class StdoutSink : public LogSink {
+public:
+    void write(const LogRecord& record) override;
+    void flush() override;
+
+private:
+    std::string _line;
+};
+
+class FileSink : public LogSink {
+public:
+    // Appends to path, throws std::system_error if it can't be opened
+    explicit FileSink(const std::string& path);
+    ~FileSink() override;
+
+    FileSink(const FileSink&) = delete;
+    FileSink& operator=(const FileSink&) = delete;
+
+    void write(const LogRecord& record) override;
+    void flush() override;
+
+private:
+    std::FILE* _file;
+    std::string _line;
+};
+
+// On-disk layout of a MmapRingSink file, read back by tools/log_ring_reader
+struct MmapRingHeader {
+    static constexpr uint64_t MAGIC   = 0x474e52474f4c5341;  // "ASLOGRNG"
+    static constexpr uint32_t VERSION = 1;
+    static constexpr size_t SIZE      = 4096;  // Slots start at this offset
+
+    uint64_t magic;
+    uint32_t version;
+    uint32_t slot_size;
+    uint64_t slot_count;
+};
+
+// Followed by slot_size - sizeof(MmapRingSlot) bytes of text. The formatted output is cut
+// into consecutive slots, so reading them in seq order gives back the log lines
+struct MmapRingSlot {
+    static constexpr uint32_t FIRST = 1;  // Text starts with a new record
+
+    uint64_t seq;  // 0 while the slot is written or still unused
+    uint32_t len;
+    uint32_t flags;
+};
+
+/**
+ * Keeps the last size bytes of log output in a memory mapped file. Records are copied into
+ * the shared mapping without a system call, the kernel writes them back even if the process
+ * is killed. Anything still queued in the logger when that happens is lost, see
+ * LoggerConfig::backend_poll_interval.
+ */
+class MmapRingSink : public LogSink {
+public:
+    // An existing file with the same geometry is continued, otherwise it's recreated.
+    // Throws std::system_error if the file can't be created or mapped
+    MmapRingSink(const std::string& path, size_t size, size_t slot_size = 256);
+    ~MmapRingSink() override;
+
+    MmapRingSink(const MmapRingSink&) = delete;
+    MmapRingSink& operator=(const MmapRingSink&) = delete;
+
+    void write(const LogRecord& record) override;
+
+    // Schedules write back to the storage, e.g. before a planned power cut
+    void flush() override;
+
+private:
+    MmapRingSlot* slot(uint64_t seq);
+
+    std::byte* _map = nullptr;
+    size_t _map_size;
+    MmapRingHeader* _header;
+    uint64_t _next_seq = 1;
+    std::string _line;
+};
+
+}
+
+#endif
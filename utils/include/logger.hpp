@@ -1,9 +1,15 @@
 #pragma once
 
+#include <atomic>
+#include <chrono>
+#include <cstdint>
 #include <fmt/format.h>
+#include <memory>
 #include <optional>
 #include <set>
 #include <string>
+#include <string_view>
+#include <time.h>
 
 
 namespace asio::logger {
@@ -23,18 +29,183 @@ enum class LogLevel : uint8_t {
 };
 
 #define DECLARE_LOG_CATEGORY(identifier) extern const asio::logger::CategoryType identifier;
-#define DEFINE_LOG_CATEGORY(identifier, name) // TODO
+// Registers the category under name, put it in exactly one translation unit
+#define DEFINE_LOG_CATEGORY(identifier, name)                                                                         \
+    const asio::logger::CategoryType identifier = asio::logger::register_category(name);
 
-#define LOG_LEVEL(categories, level, fmt_str, ...) log(level, categories, __FILE__, __LINE__, fmt::format(FMT_STRING(fmt_str) __VA_OPT__(,) __VA_ARGS__))
-#define LOG_TRACE(categories, ...) LOG_LEVEL(categories, asio::logger::LogLevel::TRACE, __VA_ARGS__)
-#define LOG_DEBUG(categories, ...) LOG_LEVEL(categories, asio::logger::LogLevel::DEBUG, __VA_ARGS__)
-#define LOG_INFO(categories, ...) LOG_LEVEL(categories, asio::logger::LogLevel::INFO, __VA_ARGS__)
-#define LOG_WARN(categories, ...) LOG_LEVEL(categories, asio::logger::LogLevel::WARN, __VA_ARGS__)
-#define LOG_ERROR(categories, ...) LOG_LEVEL(categories, asio::logger::LogLevel::ERROR, __VA_ARGS__)
-#define LOG_CRITICAL(categories, ...) LOG_LEVEL(categories, asio::logger::LogLevel::CRITICAL, __VA_ARGS__)
-#define LOG_HEX(categories, level, title, data, len) logHex(level, categories, __FILE__, __LINE__, title, data, len)
+// Statements below this level are compiled out. Set to one of the LogLevel names,
+// e.g. -DASIO_UTILS_MIN_LOG_LEVEL=INFO for release builds
+#ifndef ASIO_UTILS_MIN_LOG_LEVEL
+#define ASIO_UTILS_MIN_LOG_LEVEL TRACE
+#endif
 
+// With ASIO_UTILS_DEFERRED_LOGGING the message is formatted on the backend thread, see log_deferred.hpp
+#ifdef ASIO_UTILS_DEFERRED_LOGGING
+#define ASIO_UTILS_LOG_WRITE(categories, level, fmt_str, ...)                                                         \
+    asio::logger::detail::log_deferred(level, categories, __FILE__, __LINE__,                                         \
+                                       FMT_STRING(fmt_str) __VA_OPT__(, ) __VA_ARGS__)
+#else
+#define ASIO_UTILS_LOG_WRITE(categories, level, fmt_str, ...)                                                         \
+    asio::logger::log(level, categories, __FILE__, __LINE__, fmt::format(FMT_STRING(fmt_str) __VA_OPT__(, ) __VA_ARGS__))
+#endif
 
+// Arguments are only evaluated and formatted when the statement is enabled. level may be a runtime
+// value, statements with a constant level below MIN_LOG_LEVEL still get folded away by the optimizer
+#define LOG_LEVEL(categories, level, ...)                                                                             \
+    do {                                                                                                              \
+        if ((level) >= asio::logger::MIN_LOG_LEVEL && asio::logger::is_enabled(level, categories)) {                  \
+            ASIO_UTILS_LOG_WRITE(categories, level, __VA_ARGS__);                                                     \
+        }                                                                                                             \
+    } while (0)
+// The fixed level statements below MIN_LOG_LEVEL aren't even instantiated
+#define ASIO_UTILS_LOG_FIXED(categories, level, ...)                                                                  \
+    do {                                                                                                              \
+        if constexpr ((level) >= asio::logger::MIN_LOG_LEVEL) {                                                       \
+            if (asio::logger::is_enabled(level, categories)) {                                                        \
+                ASIO_UTILS_LOG_WRITE(categories, level, __VA_ARGS__);                                                 \
+            }                                                                                                         \
+        }                                                                                                             \
+    } while (0)
+#define LOG_TRACE(categories, ...) ASIO_UTILS_LOG_FIXED(categories, asio::logger::LogLevel::TRACE, __VA_ARGS__)
+#define LOG_DEBUG(categories, ...) ASIO_UTILS_LOG_FIXED(categories, asio::logger::LogLevel::DEBUG, __VA_ARGS__)
+#define LOG_INFO(categories, ...) ASIO_UTILS_LOG_FIXED(categories, asio::logger::LogLevel::INFO, __VA_ARGS__)
+#define LOG_WARN(categories, ...) ASIO_UTILS_LOG_FIXED(categories, asio::logger::LogLevel::WARN, __VA_ARGS__)
+#define LOG_ERROR(categories, ...) ASIO_UTILS_LOG_FIXED(categories, asio::logger::LogLevel::ERROR, __VA_ARGS__)
+#define LOG_CRITICAL(categories, ...) ASIO_UTILS_LOG_FIXED(categories, asio::logger::LogLevel::CRITICAL, __VA_ARGS__)
+#define LOG_HEX(categories, level, title, data, len)                                                                  \
+    do {                                                                                                              \
+        if ((level) >= asio::logger::MIN_LOG_LEVEL && asio::logger::is_enabled(level, categories)) {                  \
+            asio::logger::logHex(level, categories, __FILE__, __LINE__, title, data, len);                            \
+        }                                                                                                             \
+    } while (0)
+
+// Sampled statements: only every n-th enabled pass, or at most max_per_second per second, gets
+// logged. The counter and the limiter's clock read come after the level check, so a disabled
+// statement costs as much as a plain LOG_*, e.g. LOG_HEX_RATE_LIMITED(10, L_UDP, LogLevel::TRACE, ...)
+#define LOG_EVERY_N(n, categories, level, ...)                                                                        \
+    do {                                                                                                              \
+        if ((level) >= asio::logger::MIN_LOG_LEVEL && asio::logger::is_enabled(level, categories)) {                  \
+            static std::atomic<uint64_t> asio_utils_log_passes{0};                                                    \
+            if (asio_utils_log_passes.fetch_add(1, std::memory_order_relaxed) % (n) == 0) {                           \
+                ASIO_UTILS_LOG_WRITE(categories, level, __VA_ARGS__);                                                 \
+            }                                                                                                         \
+        }                                                                                                             \
+    } while (0)
+#define LOG_RATE_LIMITED(max_per_second, categories, level, ...)                                                      \
+    do {                                                                                                              \
+        if ((level) >= asio::logger::MIN_LOG_LEVEL && asio::logger::is_enabled(level, categories)) {                  \
+            static asio::logger::detail::RateLimiter asio_utils_log_limiter;                                          \
+            if (asio_utils_log_limiter.allow(max_per_second)) {                                                       \
+                ASIO_UTILS_LOG_WRITE(categories, level, __VA_ARGS__);                                                 \
+            }                                                                                                         \
+        }                                                                                                             \
+    } while (0)
+#define LOG_HEX_EVERY_N(n, categories, level, title, data, len)                                                       \
+    do {                                                                                                              \
+        if ((level) >= asio::logger::MIN_LOG_LEVEL && asio::logger::is_enabled(level, categories)) {                  \
+            static std::atomic<uint64_t> asio_utils_log_passes{0};                                                    \
+            if (asio_utils_log_passes.fetch_add(1, std::memory_order_relaxed) % (n) == 0) {                           \
+                asio::logger::logHex(level, categories, __FILE__, __LINE__, title, data, len);                        \
+            }                                                                                                         \
+        }                                                                                                             \
+    } while (0)
+#define LOG_HEX_RATE_LIMITED(max_per_second, categories, level, title, data, len)                                     \
+    do {                                                                                                              \
+        if ((level) >= asio::logger::MIN_LOG_LEVEL && asio::logger::is_enabled(level, categories)) {                  \
+            static asio::logger::detail::RateLimiter asio_utils_log_limiter;                                          \
+            if (asio_utils_log_limiter.allow(max_per_second)) {                                                       \
+                asio::logger::logHex(level, categories, __FILE__, __LINE__, title, data, len);                        \
+            }                                                                                                         \
+        }                                                                                                             \
+    } while (0)
+
+constexpr LogLevel MIN_LOG_LEVEL = LogLevel::ASIO_UTILS_MIN_LOG_LEVEL;
+
+namespace detail {
+// Categories enabled at each level, all clear while there is no sink
+extern std::atomic<CategoryType> level_masks[static_cast<size_t>(LogLevel::LEVEL_COUNT)];
+}
+
+namespace detail {
+class RateLimiter {
+public:
+    bool allow(uint32_t max_per_second) {
+        // The coarse clock is a few ns, the limit doesn't need more than tick resolution
+        timespec now;
+        clock_gettime(CLOCK_MONOTONIC_COARSE, &now);
+        if (now.tv_sec != _second.load(std::memory_order_relaxed)) {
+            _second.store(now.tv_sec, std::memory_order_relaxed);
+            _count.store(0, std::memory_order_relaxed);
+        }
+        return _count.fetch_add(1, std::memory_order_relaxed) < max_per_second;
+    }
+
+private:
+    std::atomic<int64_t> _second{-1};
+    std::atomic<uint32_t> _count{0};
+};
+}
+
+inline bool is_enabled(LogLevel level, CategoryType categories) {
+    return categories & detail::level_masks[static_cast<size_t>(level)].load(std::memory_order_relaxed);
+}
+
+// Allocates one of the 64 category bits, registering a name twice returns the same bit.
+// Returns 0, a category that is never enabled, once all bits are taken
+CategoryType register_category(const char* name);
+
+// Sets the level of every category and the default (INFO) for categories registered later
+void set_level(LogLevel level);
+
+LogLevel get_level();
+
+void set_category_level(CategoryType category, LogLevel level);
+
+// Also applies to a category registered later under that name
+void set_category_level(std::string_view name, LogLevel level);
+
+std::optional<LogLevel> get_category_level(std::string_view name);
+
+// Applies a comma separated list of name=level, "*" stands for all categories, e.g.
+// "CAN=trace,*=info". Returns EINVAL if an entry can't be parsed, the entries before it
+// are applied. The ASIO_UTILS_LOG_LEVELS environment variable is read the same way at startup
+int set_category_levels(std::string_view spec);
+
+
+class LogSink;
+
+// What a producer does when its ring buffer is full
+enum class OverflowPolicy : uint8_t {
+    DROP,   // Discard the record, visible in dropped_records() only
+    BLOCK,  // Wait for the backend to make room
+    COUNT,  // Discard the record, the backend logs how many were lost
+};
+
+struct LoggerConfig {
+    // Bytes per producer thread, rounded up to a power of two. Applies to threads that log
+    // for the first time after configure()
+    size_t ring_buffer_size        = 64 * 1024;
+    OverflowPolicy overflow_policy = OverflowPolicy::DROP;
+    // How long the backend sleeps when all ring buffers are empty
+    std::chrono::microseconds backend_poll_interval = std::chrono::milliseconds(1);
+};
+
+void configure(const LoggerConfig& config);
+
+// Records are written to every sink by a background thread. Without sinks log() is a no-op
+void add_sink(std::shared_ptr<LogSink> sink);
+
+void remove_sinks();
+
+// Blocks until everything logged before the call reached the sinks and they were flushed
+void flush();
+
+// Drains the buffers and stops the backend thread, later records are dropped
+void shutdown();
+
+uint64_t dropped_records();
+
+// Never blocks on I/O or a lock unless the overflow policy is BLOCK and the buffer is full
 void log(LogLevel level, asio::logger::CategoryType categories, const char* filename, unsigned int line_no,
          const std::string& msg);
 
@@ -43,6 +214,13 @@ void logHex(LogLevel level, asio::logger::CategoryType categories, const char* f
 
 }
 
+#ifdef ASIO_UTILS_DEFERRED_LOGGING
+#include "log_deferred.hpp"
+#endif
+
 #pragma once
 DECLARE_LOG_CATEGORY(L_ASIOUTIL);
-DEFINE_LOG_CATEGORY(L_ASIOUTIL, "AsioUtil");
+DECLARE_LOG_CATEGORY(L_CAN);
+DECLARE_LOG_CATEGORY(L_UDP);
+DECLARE_LOG_CATEGORY(L_MQTT);
+DECLARE_LOG_CATEGORY(L_TIMER);
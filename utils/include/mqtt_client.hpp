@@ -9,6 +9,8 @@
 
 #include "async_io_context.hpp"
 #include "timer.hpp"
+#include <utility>  // Boost 1.74 awaitable.hpp uses std::exchange without including it
+#include <boost/asio/awaitable.hpp>
 #include <cstdlib>
 #include <memory>
 #include <mosquitto.h>
@@ -46,6 +48,10 @@ public:
 
     virtual int publish_data(const char* topic, const void* buf, const int len, MqttQos qos, bool retain = false) = 0;
 
+    // Like publish_data, but completes once the socket took the message. Returns 0 or -1
+    virtual boost::asio::awaitable<int> async_publish(const char* topic, const void* buf, const int len, MqttQos qos,
+                                                      bool retain = false) = 0;
+
     virtual int subscribe_topic(const char* topic) = 0;
 
     virtual int unsubscribe_topic(const char* topic) = 0;
@@ -57,6 +63,9 @@ public:
     virtual int register_topic_callback(const std::string& topic, MessageCallback callback_fn) = 0;
 
     virtual void unregister_topic_callback(const std::string& topic) = 0;
+
+    // Socket and timer handlers run through the io_context's PriorityScheduler at this level
+    virtual void set_priority(HandlerPriority priority) = 0;
 };
 
 }
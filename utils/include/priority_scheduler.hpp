@@ -0,0 +1,183 @@
+#ifndef _UTILS_PRIORITY_SCHEDULER_HPP_
+#define _UTILS_PRIORITY_SCHEDULER_HPP_
+
+#include "handler_allocator.hpp"
+#include <array>
+#include <atomic>
+#include <boost/asio/io_context.hpp>
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <mutex>
+
+namespace asio::utils {
+
+enum class HandlerPriority : uint8_t {
+    CONTROL,  // Control loops and other latency critical traffic
+    HIGH,
+    NORMAL,
+    BULK,  // Telemetry, housekeeping
+    LEVEL_COUNT
+};
+
+struct PriorityQueueStats {
+    uint64_t dispatched = 0;  // Handlers run so far
+    uint64_t pending    = 0;  // Handlers waiting right now
+    std::chrono::nanoseconds total_wait{0};
+    std::chrono::nanoseconds max_wait{0};
+};
+
+/**
+ * Runs the handlers of an io_context in priority order instead of FIFO.
+ *
+ * A handler posted through an executor of this scheduler is queued by priority and a token is
+ * posted to the io_context. Whichever token runs first executes the most urgent handler waiting,
+ * so a burst of BULK handlers can't delay a CONTROL handler queued after it. Handlers that are
+ * not bound to a priority executor keep their FIFO position in the io_context queue.
+ */
+class PriorityScheduler : public boost::asio::execution_context::service {
+public:
+    class executor_type;
+
+    static boost::asio::execution_context::id id;
+
+    explicit PriorityScheduler(boost::asio::io_context& io_ctx);
+
+    executor_type get_executor(HandlerPriority priority);
+
+    // Executor of the scheduler attached to io_ctx, created on first use
+    static executor_type executor(boost::asio::io_context& io_ctx, HandlerPriority priority);
+
+    PriorityQueueStats stats(HandlerPriority priority) const;
+
+    void reset_stats();
+
+private:
+    struct QueuedHandler {
+        virtual void invoke()  = 0;
+        virtual void destroy() = 0;
+
+        std::chrono::steady_clock::time_point enqueued;
+
+    protected:
+        ~QueuedHandler() = default;
+    };
+
+    // Queue entries live in recycled handler memory, see RecyclingAllocator
+    template <typename Function>
+    struct QueuedHandlerImpl : QueuedHandler {
+        template <typename F>
+        explicit QueuedHandlerImpl(F&& f) : function(std::forward<F>(f)) {}
+
+        void invoke() override { function(); }
+
+        void destroy() override {
+            this->~QueuedHandlerImpl();
+            detail::deallocate_handler_memory(this, sizeof(QueuedHandlerImpl));
+        }
+
+        Function function;
+    };
+
+    struct QueuedHandlerDeleter {
+        void operator()(QueuedHandler* handler) const { handler->destroy(); }
+    };
+
+    using QueuedHandlerPtr = std::unique_ptr<QueuedHandler, QueuedHandlerDeleter>;
+
+    struct Level {
+        std::deque<QueuedHandlerPtr> queue;
+        std::atomic<uint64_t> dispatched{0};
+        std::atomic<uint64_t> total_wait_nsec{0};
+        std::atomic<uint64_t> max_wait_nsec{0};
+    };
+
+    void shutdown() override;
+
+    template <typename Function>
+    void enqueue(HandlerPriority priority, Function&& f);
+
+    void run_one();
+
+    boost::asio::io_context& _io_ctx;
+    mutable std::mutex _mutex;
+    std::array<Level, static_cast<size_t>(HandlerPriority::LEVEL_COUNT)> _levels;
+};
+
+class PriorityScheduler::executor_type {
+public:
+    // Pass-through executor, handlers go straight to the io_context queue
+    explicit executor_type(boost::asio::io_context& io_ctx) : _inner(io_ctx.get_executor()) {}
+
+    executor_type(PriorityScheduler& scheduler, HandlerPriority priority)
+        : _scheduler(&scheduler), _priority(priority), _inner(scheduler._io_ctx.get_executor()) {}
+
+    boost::asio::io_context& context() const noexcept { return _inner.context(); }
+
+    void on_work_started() const noexcept { _inner.on_work_started(); }
+
+    void on_work_finished() const noexcept { _inner.on_work_finished(); }
+
+    // Prioritized handlers are always queued, running them inline would jump the queue
+    template <typename Function, typename Allocator>
+    void dispatch(Function&& f, const Allocator& a) const {
+        if (_scheduler) {
+            _scheduler->enqueue(_priority, std::forward<Function>(f));
+        } else {
+            _inner.dispatch(std::forward<Function>(f), a);
+        }
+    }
+
+    template <typename Function, typename Allocator>
+    void post(Function&& f, const Allocator& a) const {
+        if (_scheduler) {
+            _scheduler->enqueue(_priority, std::forward<Function>(f));
+        } else {
+            _inner.post(std::forward<Function>(f), a);
+        }
+    }
+
+    template <typename Function, typename Allocator>
+    void defer(Function&& f, const Allocator& a) const {
+        if (_scheduler) {
+            _scheduler->enqueue(_priority, std::forward<Function>(f));
+        } else {
+            _inner.defer(std::forward<Function>(f), a);
+        }
+    }
+
+    bool operator==(const executor_type& other) const noexcept {
+        return _scheduler == other._scheduler && _priority == other._priority && _inner == other._inner;
+    }
+
+    bool operator!=(const executor_type& other) const noexcept { return !(*this == other); }
+
+private:
+    PriorityScheduler* _scheduler = nullptr;
+    HandlerPriority _priority     = HandlerPriority::NORMAL;
+    boost::asio::io_context::executor_type _inner;
+};
+
+template <typename Function>
+void PriorityScheduler::enqueue(HandlerPriority priority, Function&& f) {
+    using Impl = QueuedHandlerImpl<std::decay_t<Function>>;
+
+    void* memory = detail::allocate_handler_memory(sizeof(Impl));
+    QueuedHandlerPtr handler;
+    try {
+        handler.reset(new (memory) Impl(std::forward<Function>(f)));
+    } catch (...) {
+        detail::deallocate_handler_memory(memory, sizeof(Impl));
+        throw;
+    }
+    handler->enqueued = std::chrono::steady_clock::now();
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _levels[static_cast<size_t>(priority)].queue.push_back(std::move(handler));
+    }
+    _io_ctx.get_executor().post([this]() { run_one(); }, RecyclingAllocator<void>());
+}
+
+}
+
+#endif
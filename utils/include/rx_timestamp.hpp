@@ -0,0 +1,62 @@
+#ifndef _UTILS_RX_TIMESTAMP_HPP_
+#define _UTILS_RX_TIMESTAMP_HPP_
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <sys/socket.h>
+#include <time.h>
+
+namespace asio::utils {
+
+// Kernel receive time of a frame or datagram since the epoch. Zero when the socket doesn't
+// provide that kind of timestamp. Hardware stamps are in the NIC's clock
+struct RxTimestamp {
+    std::chrono::nanoseconds software{0};
+    std::chrono::nanoseconds hardware{0};
+};
+
+struct RxLatencyStats {
+    static constexpr size_t LATENCY_BUCKETS = 16;
+
+    uint64_t count = 0;
+    std::chrono::nanoseconds total_latency{0};
+    std::chrono::nanoseconds max_latency{0};
+    // Bucket i counts callbacks that started [2^(i-1), 2^i) us after the kernel's software
+    // timestamp, bucket 0 the ones within 1us and the last bucket everything later
+    std::array<uint64_t, LATENCY_BUCKETS> latency_histogram{};
+};
+
+// Control message buffer with room for SCM_TIMESTAMPNS or SCM_TIMESTAMPING
+struct alignas(cmsghdr) RxTimestampControl {
+    char data[CMSG_SPACE(sizeof(timespec) * 3)];
+};
+
+// SO_TIMESTAMPING with software and hardware receive stamps when hardware is set, SO_TIMESTAMPNS
+// otherwise. Hardware stamps also need RX timestamping enabled on the interface (SIOCSHWTSTAMP).
+// Returns 0 or errno
+int enable_rx_timestamps(int fd, bool hardware);
+
+RxTimestamp parse_rx_timestamp(const msghdr& msg);
+
+// Kernel to callback latency, recorded by a receive loop and read from any thread
+class RxLatencyRecorder {
+public:
+    // Ignores timestamps without a software stamp
+    void record(const RxTimestamp& timestamp);
+
+    RxLatencyStats stats() const;
+
+    void reset();
+
+private:
+    std::atomic<uint64_t> _count{0};
+    std::atomic<int64_t> _total_latency_ns{0};
+    std::atomic<int64_t> _max_latency_ns{0};
+    std::array<std::atomic<uint64_t>, RxLatencyStats::LATENCY_BUCKETS> _latency_histogram{};
+};
+
+}
+
+#endif
@@ -18,6 +18,25 @@ int safe_stoi_default(const std::string& string, int default_value);
 void clear(std::stringstream& buf);
 std::optional<std::pair<std::string, uint32_t>> split_url_into_address_and_port(std::string url);
 
+// Writes each byte as two lower case hex digits followed by a space, 3 * len chars in total.
+// Uses AVX2 or SSSE3 when the CPU has it
+char* hex_dump(char* out, const uint8_t* data, size_t len);
+
+// Appends "0a 1b 2c", without a trailing space
+void append_hex(std::string& out, const void* data, size_t len);
+
+namespace detail {
+using HexKernel = char* (*)(char* out, const uint8_t* data, size_t len);
+
+// The hex_dump implementations, for benchmarks. ssse3 and avx2 are null when the CPU lacks them
+struct HexKernels {
+    HexKernel scalar = nullptr;
+    HexKernel ssse3  = nullptr;
+    HexKernel avx2   = nullptr;
+};
+HexKernels hex_kernels();
+}
+
 }
 
 #endif
@@ -1,14 +1,41 @@
 #ifndef _UTILS_TIMER_HPP_
 #define _UTILS_TIMER_HPP_
 
+#include "priority_scheduler.hpp"
+#include "timer_service.hpp"
+#include <array>
+#include <atomic>
 #include <boost/asio.hpp>
+#include <utility>  // Boost 1.74 awaitable.hpp uses std::exchange without including it
+#include <boost/asio/awaitable.hpp>
 #include <functional>
+#include <memory>
+#include <optional>
 #include <string>
+#include <vector>
 
 namespace asio::utils {
 
 static const char* TIMER_DEFAULT_NAME = "Timer";
 
+enum class PeriodicMode : uint8_t {
+    RELATIVE,  // Next expiry is one period after the callback ran, callback time adds up as drift
+    CATCH_UP,  // Expiries at start + n * period, missed ones run back to back
+    SKIP,      // Expiries at start + n * period, missed ones are dropped
+};
+
+struct TimerStats {
+    static constexpr size_t JITTER_BUCKETS = 16;
+
+    uint64_t expirations       = 0;
+    uint64_t skipped_deadlines = 0;  // Dropped by PeriodicMode::SKIP
+    std::chrono::nanoseconds total_lateness{0};
+    std::chrono::nanoseconds max_lateness{0};
+    // Bucket i counts callbacks that ran [2^(i-1), 2^i) us after their deadline, bucket 0
+    // the ones within 1us and the last bucket everything later
+    std::array<uint64_t, JITTER_BUCKETS> jitter_histogram{};
+};
+
 struct TimerConfig {
 
     std::string name{TIMER_DEFAULT_NAME};
@@ -16,9 +43,34 @@ struct TimerConfig {
     std::function<void()> callback_fn;
     std::chrono::milliseconds start_interval_msec    = std::chrono::milliseconds(0);
     std::chrono::milliseconds periodic_interval_msec = std::chrono::milliseconds(0);
+    // Finer grained alternatives, used instead of the *_msec fields when non zero
+    std::chrono::nanoseconds start_interval{0};
+    std::chrono::nanoseconds periodic_interval{0};
+
+    // Run the callback through the io_context's PriorityScheduler at this level
+    std::optional<HandlerPriority> priority;
+
+    // Expire through the io_context's TimerService timing wheel instead of an own steady_timer.
+    // Intervals are rounded up to TimerService::TICK
+    bool use_timer_service = false;
+
+    // Expire through a timerfd of this timer armed with absolute CLOCK_MONOTONIC deadlines,
+    // for sub-millisecond intervals. Takes precedence over use_timer_service
+    bool high_resolution = false;
+
+    // Expiries may run up to this much late so they share a wakeup with other timers.
+    // Non zero slack puts the timer on the TimerService unless high_resolution is set
+    std::chrono::nanoseconds slack{0};
+
+    PeriodicMode periodic_mode = PeriodicMode::RELATIVE;
 };
 
 
+/**
+ * Control calls (start, stop, restart, setters) may come from any thread and never block: they
+ * update an atomic state and post the actual arming or cancelling to the timer's strand. The
+ * callback runs on that strand without a lock held, so it may call back into the timer.
+ */
 class Timer : public std::enable_shared_from_this<Timer> {
 public:
     static std::shared_ptr<Timer> create(const TimerConfig& config,
@@ -41,8 +93,15 @@ public:
                  std::chrono::milliseconds start_interval_msec    = std::chrono::milliseconds(0),
                  std::chrono::milliseconds periodic_interval_msec = std::chrono::milliseconds(0));
 
+    void restart(std::function<void()> callback_fn, std::chrono::nanoseconds start_interval,
+                 std::chrono::nanoseconds periodic_interval);
+
     bool is_started();
 
+    // Completes after the next expiry, starting the timer if needed. Throws
+    // boost::system::system_error(operation_aborted) when the timer is stopped first
+    boost::asio::awaitable<void> async_wait();
+
     void stop();
 
     void set_start_interval_msec(std::chrono::milliseconds interval_msec);
@@ -53,27 +112,123 @@ public:
 
     std::chrono::milliseconds get_periodic_interval_msec() const;
 
+    void set_start_interval(std::chrono::nanoseconds interval);
+
+    std::chrono::nanoseconds get_start_interval() const;
+
+    void set_periodic_interval(std::chrono::nanoseconds interval);
+
+    std::chrono::nanoseconds get_periodic_interval() const;
+
     void set_callback(std::function<void()> callback_fn);
 
+    // Applies to handlers posted from now on
+    void set_priority(HandlerPriority priority);
+
+    // Lateness of the callbacks against their deadline, since creation or reset_stats()
+    TimerStats stats() const;
+
+    void reset_stats();
+
 protected:
     Timer(const TimerConfig& config, boost::asio::io_context& _io_context);
 
 private:
+    // Forwards to the PriorityScheduler at the timer's current priority, so set_priority()
+    // doesn't have to replace the strand under handlers already queued on it. Doesn't refer to
+    // the Timer, the strand keeps copies alive after a handler dropped the last reference to it
+    class Executor {
+    public:
+        Executor(boost::asio::io_context& io_context, PriorityScheduler& scheduler,
+                 std::shared_ptr<std::atomic<HandlerPriority>> priority)
+            : _io_context(&io_context), _scheduler(&scheduler), _priority(std::move(priority)) {}
+
+        boost::asio::io_context& context() const noexcept { return *_io_context; }
+
+        void on_work_started() const noexcept { context().get_executor().on_work_started(); }
+
+        void on_work_finished() const noexcept { context().get_executor().on_work_finished(); }
+
+        template <typename Function, typename Allocator>
+        void dispatch(Function&& f, const Allocator& a) const {
+            current().dispatch(std::forward<Function>(f), a);
+        }
+
+        template <typename Function, typename Allocator>
+        void post(Function&& f, const Allocator& a) const {
+            current().post(std::forward<Function>(f), a);
+        }
+
+        template <typename Function, typename Allocator>
+        void defer(Function&& f, const Allocator& a) const {
+            current().defer(std::forward<Function>(f), a);
+        }
+
+        bool operator==(const Executor& other) const noexcept { return _priority == other._priority; }
+
+        bool operator!=(const Executor& other) const noexcept { return _priority != other._priority; }
+
+    private:
+        PriorityScheduler::executor_type current() const;
+
+        boost::asio::io_context* _io_context;
+        PriorityScheduler* _scheduler;
+        std::shared_ptr<std::atomic<HandlerPriority>> _priority;
+    };
+
+    // Odd while the timer runs. Every start, stop and restart moves it forward, so an expiry
+    // armed under an older value is recognised as stale
+    static constexpr uint64_t RUNNING = 1;
+
+    template <typename Function>
+    void post(Function&& f);
+    void apply_state(uint64_t state);
+    void disarm();
     void timer_async_wait(bool first_run);
 
-    void timer_callback(const std::error_code& ec);
-    void start_noLock();
+    void on_expiry(uint64_t state);
+    void timer_callback(const boost::system::error_code& ec, uint64_t state);
+    void wheel_callback(uint64_t generation);
+    void timerfd_wait();
+    void timerfd_callback(const boost::system::error_code& ec, uint64_t state);
 
-    void stop_no_lock();
     void call_callback();
 
-    std::function<void()> _callback;
-    std::chrono::milliseconds _start_interval_msec;     
-    std::chrono::milliseconds _periodic_interval_msec;  
-    std::unique_ptr<boost::asio::steady_timer> _timer;  
-    mutable std::recursive_mutex _mutex;
+    struct Waiter;
+    template <typename Handler>
+    struct WaiterImpl;
+    struct WheelEntry;
+    void complete_waiters(const boost::system::error_code& ec);
+    void record_lateness(std::chrono::steady_clock::time_point now);
+
     boost::asio::io_context& _io_context;
-    boost::asio::strand<boost::asio::io_context::executor_type> _strand;
+    PriorityScheduler& _scheduler;
+    // LEVEL_COUNT when handlers bypass the scheduler, shared with the strand's executor
+    std::shared_ptr<std::atomic<HandlerPriority>> _priority;
+    boost::asio::strand<Executor> _strand;
+    std::atomic<uint64_t> _state{0};
+    std::atomic<std::chrono::nanoseconds> _start_interval;
+    std::atomic<std::chrono::nanoseconds> _periodic_interval;
+    const bool _high_resolution;
+    const std::chrono::nanoseconds _slack;
+    const PeriodicMode _periodic_mode;
+
+    // Only touched on _strand
+    std::function<void()> _callback;
+    std::unique_ptr<boost::asio::steady_timer> _timer;
+    std::unique_ptr<boost::asio::posix::stream_descriptor> _timerfd;
+    TimerService* _timer_service = nullptr;
+    std::unique_ptr<WheelEntry> _wheel_entry;
+    uint64_t _armed_state = 0;
+    std::chrono::steady_clock::time_point _deadline;
+    std::vector<std::unique_ptr<Waiter>> _waiters;
+
+    // Written on _strand only, read by stats() from any thread
+    std::atomic<uint64_t> _expirations{0};
+    std::atomic<uint64_t> _skipped_deadlines{0};
+    std::atomic<int64_t> _total_lateness_ns{0};
+    std::atomic<int64_t> _max_lateness_ns{0};
+    std::array<std::atomic<uint64_t>, TimerStats::JITTER_BUCKETS> _jitter_histogram{};
 };
 
 }
@@ -0,0 +1,105 @@
+#ifndef _UTILS_TIMER_SERVICE_HPP_
+#define _UTILS_TIMER_SERVICE_HPP_
+
+#include <array>
+#include <atomic>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+
+namespace asio::utils {
+
+/**
+ * Hierarchical timing wheel shared by all timers of an io_context.
+ *
+ * Five levels of 64 slots cover about 12 days at TICK resolution. Scheduling and cancelling an
+ * entry is O(1), entries of the higher levels move down a level each time the lower level
+ * wraps. A single steady_timer is armed for the next tick that has work, so the asio timer
+ * queue holds one timer no matter how many entries are pending.
+ *
+ * An entry scheduled with slack may expire up to that much late. It's moved onto the wakeup
+ * already armed when that one falls inside its window, otherwise onto a tick aligned to the
+ * slack, so entries with overlapping windows end up sharing one wakeup.
+ */
+class TimerService : public boost::asio::execution_context::service {
+public:
+    static constexpr std::chrono::milliseconds TICK{1};
+
+    // Object kept in the wheel. Owners cancel it before it's destroyed
+    class Entry {
+    public:
+        Entry()                        = default;
+        Entry(const Entry&)            = delete;
+        Entry& operator=(const Entry&) = delete;
+
+        // Changes on every schedule() and cancel(), tells a stale expiry from the current one
+        uint64_t generation() const { return _generation.load(std::memory_order_acquire); }
+
+    protected:
+        ~Entry() = default;
+
+    private:
+        friend class TimerService;
+
+        // Called with the service's lock held, implementations post the actual work
+        virtual void expired(uint64_t generation) = 0;
+
+        Entry* _prev = nullptr;
+        Entry* _next = nullptr;
+        Entry** _slot = nullptr;  // List head the entry is linked into, nullptr when idle
+        uint64_t _expiry_tick = 0;
+        std::atomic<uint64_t> _generation{0};
+    };
+
+    static boost::asio::execution_context::id id;
+
+    explicit TimerService(boost::asio::io_context& io_ctx);
+
+    // Service attached to io_ctx, created on first use
+    static TimerService& get(boost::asio::io_context& io_ctx);
+
+    // Expires entry after delay, rounded up to whole ticks, and at most slack later. Replaces a
+    // pending expiry
+    void schedule(Entry& entry, std::chrono::steady_clock::duration delay,
+                  std::chrono::steady_clock::duration slack = std::chrono::steady_clock::duration::zero());
+
+    void cancel(Entry& entry);
+
+    size_t size() const;
+
+    // Expiries that shared a tick with another expiry instead of needing their own wakeup
+    uint64_t wakeups_saved() const;
+
+private:
+    static constexpr size_t LEVEL_BITS = 6;
+    static constexpr size_t SLOTS      = size_t(1) << LEVEL_BITS;
+    static constexpr size_t LEVELS     = 5;
+
+    void shutdown() override;
+
+    uint64_t tick_of(std::chrono::steady_clock::time_point time) const;
+    void link(Entry& entry);
+    void unlink(Entry& entry);
+    uint64_t next_event() const;
+    void advance(uint64_t tick);
+    void cascade(size_t level);
+    void arm();
+    void on_timer(const boost::system::error_code& ec);
+
+    mutable std::mutex _mutex;
+    boost::asio::steady_timer _timer;
+    const std::chrono::steady_clock::time_point _epoch;
+    uint64_t _current_tick = 0;  // Every tick up to this one was processed
+    uint64_t _armed_tick   = 0;  // 0 while _timer isn't armed
+    size_t _size           = 0;
+    uint64_t _expired_entries = 0;
+    uint64_t _expired_ticks   = 0;  // Ticks that expired at least one entry
+    std::array<std::array<Entry*, SLOTS>, LEVELS> _slots{};
+    std::array<uint64_t, LEVELS> _occupied{};  // Bit per non empty slot
+};
+
+}
+
+#endif
@@ -1,7 +1,12 @@
 #ifndef _UDP_CLIENT_HPP_
 #define _UDP_CLIENT_HPP_
 
+#include "priority_scheduler.hpp"
+#include "rx_timestamp.hpp"
+#include <utility>  // Boost 1.74 awaitable.hpp uses std::exchange without including it
+#include <boost/asio/awaitable.hpp>
 #include <boost/asio/ip/udp.hpp>
+#include <chrono>
 #include <set>
 
 namespace asio::utils {
@@ -13,6 +18,8 @@ public:
 
     using data_handler_t = std::function<void(const boost::system::error_code& error, size_t bytes_transferred)>;
     using callback_t     = std::function<void(std::vector<char>& data, size_t size)>;
+    using timestamped_callback_t =
+        std::function<void(std::vector<char>& data, size_t size, const RxTimestamp& timestamp)>;
 
     static std::unique_ptr<UdpClient> create(boost::asio::io_context& io, const std::string& addr,
                                              uint16_t receive_port, uint16_t send_port);
@@ -23,7 +30,31 @@ public:
 
     virtual int register_callback(const char* id, callback_t&& callback) = 0;
 
+    // Like register_callback, also passing the kernel receive timestamp of the datagram. It stays
+    // zero until enable_rx_timestamps()
+    virtual int register_timestamped_callback(const char* id, timestamped_callback_t&& callback) = 0;
+
     virtual int unregister_callback(const char* id) = 0;
+
+    // Opt-in SO_TIMESTAMPNS, or SO_TIMESTAMPING with hardware stamps. Returns 0 or errno
+    virtual int enable_rx_timestamps(bool hardware = false) = 0;
+
+    // Time from the kernel's software timestamp to the callbacks of the receive loop.
+    // Safe to call from any thread
+    virtual RxLatencyStats rx_latency_stats() const = 0;
+
+    virtual void reset_rx_latency_stats() = 0;
+
+    // Receives the next datagram into buffer, throws boost::system::system_error on failure.
+    // The callback receive loop only starts with the first register_callback, so don't mix both
+    virtual boost::asio::awaitable<size_t> async_receive(boost::asio::mutable_buffer buffer) = 0;
+
+    // Sets SO_BUSY_POLL on the socket, returns 0 or errno
+    virtual int set_busy_poll(std::chrono::microseconds budget) = 0;
+
+    // Completion handlers of operations started afterwards run through the io_context's
+    // PriorityScheduler at this level
+    virtual void set_priority(HandlerPriority priority) = 0;
 };
 }
 #endif
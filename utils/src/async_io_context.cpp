@@ -1,48 +1,330 @@
 #include "async_io_context.hpp"
 #include "logger.hpp"
 
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
 #include <iostream>
+#include <pthread.h>
+#include <sched.h>
+#include <system_error>
 
 using namespace asio::utils;
 
-AsyncIoContext::AsyncIoContext(int pool_size)
-    : _async_context(), _work_guard(boost::asio::make_work_guard(_async_context)), _thread_pool() {
-    
-    if (pool_size < THREADPOOL_MIN_SIZE) {
-        pool_size = THREADPOOL_MIN_SIZE;
+static thread_local bool t_ran_probe = false;
+
+AsyncIoContext::Shard::Shard(int concurrency_hint)
+    : context(concurrency_hint), work_guard(boost::asio::make_work_guard(context)) {}
+
+static AsyncIoContextConfig pool_config(int pool_size)
+{
+    AsyncIoContextConfig config;
+    config.pool_size = pool_size;
+    return config;
+}
+
+AsyncIoContext::AsyncIoContext(int pool_size) : AsyncIoContext(pool_config(pool_size)) {}
+
+static const char* backend_name(IoBackend backend)
+{
+    switch (backend) {
+    case IoBackend::EPOLL:
+        return "epoll";
+    case IoBackend::IO_URING:
+        return "io_uring";
+    default:
+        return "auto";
+    }
+}
+
+AsyncIoContext::AsyncIoContext(const AsyncIoContextConfig& config)
+    : _shards(), _thread_pool() {
+
+    if (config.backend != IoBackend::AUTO && config.backend != backend()) {
+        throw std::system_error(
+            ENOTSUP, std::generic_category(),
+            fmt::format("I/O backend {} requested, library is built with {}", backend_name(config.backend),
+                        backend_name(backend())));
+    }
+    LOG_INFO(L_ASIOUTIL, "Using {} I/O backend", backend_name(backend()));
+
+    int pool_size = config.pool_size;
+    int min_size  = THREADPOOL_MIN_SIZE;
+    if (config.sharded) {
+        min_size = 1;
+    }
+    else if (config.elastic) {
+        min_size = std::clamp(config.min_threads, 1, THREADPOOL_MAX_SIZE);
+    }
+
+    if (pool_size < min_size) {
+        pool_size = min_size;
     }
     else if (pool_size > THREADPOOL_MAX_SIZE) {
         pool_size = THREADPOOL_MAX_SIZE;
     }
-    
+
+    if (config.sharded) {
+        // A single runner per io_context lets asio skip cross-thread scheduling
+        for (int i = 0; i < pool_size; i++) {
+            _shards.emplace_back(std::make_unique<Shard>(1));
+        }
+    }
+    else {
+        _shards.emplace_back(std::make_unique<Shard>(pool_size));
+    }
+
+    if (config.elastic && !config.sharded) {
+        _elastic                   = std::make_unique<ElasticPool>();
+        _elastic->min_threads      = min_size;
+        _elastic->max_threads      = pool_size;
+        _elastic->grow_latency     = config.grow_latency;
+        _elastic->idle_timeout     = config.idle_timeout;
+        _elastic->monitor_interval = config.monitor_interval;
+        _elastic->cpu_cores        = config.cpu_cores;
+
+        std::lock_guard<std::mutex> lock(_elastic->mutex);
+        for (int i = 0; i < _elastic->min_threads; i++) {
+            spawn_elastic_thread();
+        }
+        _elastic->monitor = std::thread([this]() { monitor_elastic_pool(); });
+        return;
+    }
+
+    _busy_poll_budget = config.busy_poll_budget;
     for (int i = 0; i < pool_size; i++) {
-        _thread_pool.emplace_back([this, i]() {
-            LOG_INFO(L_ASIOUTIL, "Thread {} Started", i);
-            while (true) {
-                try {
-                    this->_async_context.run();
+        int cpu = config.cpu_cores.empty() ? -1 : config.cpu_cores[i % config.cpu_cores.size()];
+        _thread_pool.emplace_back(make_thread(*_shards[i % _shards.size()], i, cpu));
+    }
+}
+
+std::thread AsyncIoContext::make_thread(Shard& shard, int thread_idx, int cpu)
+{
+    return std::thread([this, &shard, thread_idx, cpu]() {
+        if (cpu >= 0) {
+            cpu_set_t cpu_set;
+            CPU_ZERO(&cpu_set);
+            CPU_SET(cpu, &cpu_set);
+            int ret = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set);
+            if (ret != 0) {
+                LOG_WARN(L_ASIOUTIL, "Thread {} can't be pinned to CPU {}: {}", thread_idx, cpu, strerror(ret));
+            }
+        }
+        LOG_INFO(L_ASIOUTIL, "Thread {} Started", thread_idx);
+        if (_elastic) {
+            run_elastic(shard, thread_idx);
+        }
+        else if (_busy_poll_budget.count() > 0) {
+            run_busy_poll(shard, thread_idx);
+        }
+        else {
+            run_fixed(shard, thread_idx);
+        }
+        LOG_DEBUG(L_ASIOUTIL, "Thread {} Terminated", thread_idx);
+    });
+}
+
+void AsyncIoContext::run_fixed(Shard& shard, int /* thread_idx */)
+{
+    while (true) {
+        try {
+            shard.context.run();
+            break;
+        }
+        catch (const std::exception& e) {
+            LOG_ERROR(L_ASIOUTIL, "Thread error: {}", e.what());
+        }
+    }
+}
+
+void AsyncIoContext::run_busy_poll(Shard& shard, int /* thread_idx */)
+{
+    while (!shard.context.stopped()) {
+        try {
+            auto deadline = std::chrono::steady_clock::now() + _busy_poll_budget;
+            while (!shard.context.stopped()) {
+                auto now = std::chrono::steady_clock::now();
+                if (shard.context.poll() != 0) {
+                    deadline = now + _busy_poll_budget;
+                }
+                else if (now >= deadline) {
                     break;
                 }
-                catch (const std::exception& e) {
-                    LOG_ERROR(L_ASIOUTIL, "Thread error: {}", e.what());
+            }
+            shard.context.run_one();
+        }
+        catch (const std::exception& e) {
+            LOG_ERROR(L_ASIOUTIL, "Thread error: {}", e.what());
+        }
+    }
+}
+
+void AsyncIoContext::run_elastic(Shard& shard, int thread_idx)
+{
+    auto last_busy = std::chrono::steady_clock::now();
+    while (!shard.context.stopped()) {
+        try {
+            auto idle_for = std::chrono::steady_clock::now() - last_busy;
+            if (idle_for >= _elastic->idle_timeout) {
+                if (try_retire()) {
+                    LOG_DEBUG(L_ASIOUTIL, "Thread {} idle for {}ms, retiring", thread_idx,
+                              _elastic->idle_timeout.count());
+                    break;
                 }
+                last_busy = std::chrono::steady_clock::now();
+                continue;
+            }
+
+            // Latency probes don't count as work, otherwise they'd keep every thread alive
+            t_ran_probe = false;
+            if (shard.context.run_one_for(_elastic->idle_timeout - idle_for) != 0 && !t_ran_probe) {
+                last_busy = std::chrono::steady_clock::now();
             }
-            LOG_DEBUG(L_ASIOUTIL, "Thread {} Terminated", i);
-        });
+        }
+        catch (const std::exception& e) {
+            LOG_ERROR(L_ASIOUTIL, "Thread error: {}", e.what());
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(_elastic->mutex);
+    _elastic->exited.push_back(std::this_thread::get_id());
+}
+
+bool AsyncIoContext::try_retire()
+{
+    int active = _elastic->active.load();
+    while (active > _elastic->min_threads) {
+        if (_elastic->active.compare_exchange_weak(active, active - 1)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// caller must hold _elastic->mutex
+void AsyncIoContext::spawn_elastic_thread()
+{
+    int thread_idx = _elastic->spawned++;
+    int cpu = _elastic->cpu_cores.empty() ? -1 : _elastic->cpu_cores[thread_idx % _elastic->cpu_cores.size()];
+    _elastic->active++;
+    _elastic->threads.emplace_back(make_thread(*_shards.front(), thread_idx, cpu));
+}
+
+// caller must hold _elastic->mutex
+void AsyncIoContext::reap_exited_threads()
+{
+    for (auto id : _elastic->exited) {
+        auto it = std::find_if(_elastic->threads.begin(), _elastic->threads.end(),
+                               [id](const std::thread& t) { return t.get_id() == id; });
+        if (it != _elastic->threads.end()) {
+            it->join();
+            _elastic->threads.erase(it);
+        }
+    }
+    _elastic->exited.clear();
+}
+
+void AsyncIoContext::monitor_elastic_pool()
+{
+    auto& ctx = _shards.front()->context;
+
+    std::unique_lock<std::mutex> lock(_elastic->mutex);
+    while (!_elastic->monitor_cv.wait_for(lock, _elastic->monitor_interval, [this] { return _elastic->stopping; })) {
+        reap_exited_threads();
+
+        // A probe still queued counts with its current age, so a pool whose threads are all
+        // blocked in long handlers grows without waiting for the probe to be dispatched
+        auto now = std::chrono::steady_clock::now();
+        auto latency = std::chrono::microseconds(_elastic->probe_latency_usec.load());
+        if (_elastic->probe_pending) {
+            latency = std::max(latency,
+                               std::chrono::duration_cast<std::chrono::microseconds>(now - _elastic->probe_posted));
+        }
+
+        if (latency >= _elastic->grow_latency && _elastic->active < _elastic->max_threads) {
+            LOG_DEBUG(L_ASIOUTIL, "Handler queue latency {}us, growing pool to {} threads", latency.count(),
+                      _elastic->active + 1);
+            spawn_elastic_thread();
+            _elastic->probe_latency_usec = 0;
+        }
+
+        if (!_elastic->probe_pending) {
+            _elastic->probe_pending = true;
+            _elastic->probe_posted  = now;
+            boost::asio::post(ctx, [this, now]() {
+                t_ran_probe = true;
+                auto delay = std::chrono::steady_clock::now() - now;
+                _elastic->probe_latency_usec =
+                    std::chrono::duration_cast<std::chrono::microseconds>(delay).count();
+                _elastic->probe_pending = false;
+            });
+        }
     }
 }
 
 AsyncIoContext::~AsyncIoContext()
 {
-    _work_guard.reset();
-    _async_context.stop();
+    if (_elastic) {
+        {
+            std::lock_guard<std::mutex> lock(_elastic->mutex);
+            _elastic->stopping = true;
+        }
+        _elastic->monitor_cv.notify_all();
+        _elastic->monitor.join();
+    }
+
+    for (auto& shard : _shards) {
+        shard->work_guard.reset();
+        shard->context.stop();
+    }
     for (auto& thread : _thread_pool) {
         thread.join();
     }
+    if (_elastic) {
+        // Exiting threads take the mutex, so join outside of it
+        std::list<std::thread> threads;
+        {
+            std::lock_guard<std::mutex> lock(_elastic->mutex);
+            threads.swap(_elastic->threads);
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    }
     LOG_DEBUG(L_ASIOUTIL, "Joined All Threads");
 }
 
 boost::asio::io_context& AsyncIoContext::io_ctx()
 {
-    return _async_context;
+    if (_shards.size() == 1) {
+        return _shards.front()->context;
+    }
+    return io_ctx(_next_shard.fetch_add(1, std::memory_order_relaxed));
+}
+
+boost::asio::io_context& AsyncIoContext::io_ctx(std::size_t shard)
+{
+    return _shards[shard % _shards.size()]->context;
+}
+
+std::size_t AsyncIoContext::shard_count() const
+{
+    return _shards.size();
+}
+
+IoBackend AsyncIoContext::backend()
+{
+#if defined(BOOST_ASIO_HAS_IO_URING) && defined(BOOST_ASIO_DISABLE_EPOLL)
+    return IoBackend::IO_URING;
+#else
+    return IoBackend::EPOLL;
+#endif
+}
+
+int AsyncIoContext::thread_count() const
+{
+    if (_elastic) {
+        return _elastic->active.load();
+    }
+    return static_cast<int>(_thread_pool.size());
 }
@@ -1,13 +1,21 @@
 #include "can.hpp"
 
+#include "handler_allocator.hpp"
 #include "logger.hpp"
+#include <array>
 #include <boost/asio.hpp>
 #include <linux/can.h>
 #include <linux/can/raw.h>
+#include <deque>
 #include <memory>
+#include <mutex>
 #include <stdexcept>
 #include <sys/ioctl.h>
 #include <sys/socket.h>
+#include <unordered_map>
+#include <vector>
+
+DEFINE_LOG_CATEGORY(L_CAN, "CAN");
 
 namespace asio::utils::can {
 
@@ -17,27 +25,110 @@ public:
     CanImpl(boost::asio::io_context& io_ctx, int socket_fd);
     void async_read(CanReadHandler&& can_read_handler) override;
     void async_send(const canfd_frame& frame, const CanSendHandler& handler) override;
+    size_t tx_queue_depth() const override;
+    void set_tx_high_water_mark(size_t mark, CanTxHighWaterHandler&& handler) override;
+    int set_filters(std::span<const can_filter> filters) override;
+    int set_error_filter(can_err_mask_t mask) override;
+    SubscriptionId subscribe(canid_t can_id, CanReadHandler&& handler, canid_t mask) override;
+    void unsubscribe(SubscriptionId id) override;
     void register_read_callback(CanReadHandler&& can_read_handler) override;
+    void register_batch_read_callback(CanBatchReadHandler&& can_batch_read_handler, size_t max_batch) override;
+    void register_timestamped_read_callback(CanTimestampedReadHandler&& handler, size_t max_batch) override;
+    int enable_rx_timestamps(bool hardware) override;
+    RxLatencyStats rx_latency_stats() const override;
+    void reset_rx_latency_stats() override;
+    boost::asio::awaitable<canfd_frame> async_read_frame() override;
+    boost::asio::awaitable<void> async_send_frame(const canfd_frame& frame) override;
+    int set_busy_poll(std::chrono::microseconds budget) override;
+    void set_priority(HandlerPriority priority) override;
 
     ~CanImpl() override;
 
 private:
-    using async_read_internal_handler_t = std::function<void(const boost::system::error_code& err,
-                                                             std::size_t bytes_transferred, const canfd_frame& frame)>;
-    void async_read_internal(async_read_internal_handler_t&& h);
-    void handle_write(const boost::system::error_code& err, std::size_t bytes_transferred,
-                      const CanSendHandler& handler);  // Handler for can messages
+    static constexpr size_t TX_BATCH = 32;
+    static constexpr std::chrono::milliseconds TX_RETRY_MIN{1};
+    static constexpr std::chrono::milliseconds TX_RETRY_MAX{32};
+    static constexpr std::chrono::milliseconds RX_RETRY_MIN{1};
+    static constexpr std::chrono::milliseconds RX_RETRY_MAX{1000};
+
+    struct TxEntry {
+        canfd_frame frame;
+        CanSendHandler handler;
+    };
+
+    struct Subscription {
+        bool extended;
+        canid_t can_id;  // Already masked
+        canid_t mask;
+        CanReadHandler handler;
+    };
+    using SubscriptionList = std::vector<Subscription*>;
+
+    void post_flush_tx();
+    void post_high_water(bool above);
+    void flush_tx();
+    void tx_dequeued(size_t count, const boost::system::error_code& err);
+
+    bool check_read(const boost::system::error_code& err, std::size_t bytes_transferred);
+
+    void async_read_repeat(std::shared_ptr<CanImpl> self, uint64_t generation);
+    void handle_read_repeat(const boost::system::error_code& err, std::size_t bytes_transferred,
+                            std::shared_ptr<CanImpl> self, uint64_t generation);
 
-    void handle_read(const boost::system::error_code& err, std::size_t bytes_transferred, const canfd_frame& frame,
-                     const CanReadHandler& can_read_handler);
+    void dispatch(const canfd_frame& frame);
+    static void call_subscribers(const SubscriptionList& subscribers, const canfd_frame& frame);
+    void remove_subscription(SubscriptionId id);
 
-    void handle_read_repeat(const boost::system::error_code& err, std::size_t bytes_transferred,
-                            const canfd_frame& frame, const CanReadHandler& can_read_handler);
+    void start_batch_read(size_t max_batch);
+    void async_wait_batch(uint64_t generation);
+    void handle_batch_read(const boost::system::error_code& err, uint64_t generation);
+    void retry_batch_read(uint64_t generation);
 
     int create_can_socket(const std::string& can_device_name);
 
+    boost::asio::io_context& _io_ctx;
     boost::asio::posix::stream_descriptor _can_stream;
+    PriorityScheduler::executor_type _executor;
     CanReadHandler _can_read_cb;
+    canfd_frame _rx_frame = {};  // Reused by every read of the register_read_callback loop
+    CanBatchReadHandler _can_batch_read_cb;
+    std::vector<canfd_frame> _batch_frames;
+    std::vector<iovec> _batch_iov;
+    std::vector<mmsghdr> _batch_msgs;
+    std::vector<RxTimestampControl> _batch_control;
+    std::vector<RxTimestamp> _batch_timestamps;
+    CanTimestampedReadHandler _can_timestamped_read_cb;
+    bool _rx_timestamps = false;
+    RxLatencyRecorder _rx_latency;
+    uint64_t _read_generation = 0;  // Bumped by every registration, ends the drain loop of an older one
+    boost::asio::steady_timer _rx_retry_timer;
+    std::chrono::milliseconds _rx_retry_delay = RX_RETRY_MIN;
+
+    // Held while the tables change and for a whole dispatch, recursive as handlers may subscribe
+    // and unsubscribe. Another thread's unsubscribe returns once its handler can't run anymore
+    std::recursive_mutex _subscription_mutex;
+    std::unordered_map<SubscriptionId, std::unique_ptr<Subscription>> _subscriptions;
+    SubscriptionId _next_subscription = 1;
+    // 11 bit masks are expanded into every ID they match, 29 bit IDs are looked up exactly and
+    // only 29 bit masks are matched one by one
+    std::unique_ptr<std::array<SubscriptionList, CAN_SFF_MASK + 1>> _sff_subscribers;
+    std::unordered_map<canid_t, SubscriptionList> _eff_subscribers;
+    SubscriptionList _eff_masked_subscribers;
+    bool _dispatching = false;
+    std::vector<SubscriptionId> _pending_unsubscribe;
+
+    mutable std::mutex _tx_mutex;
+    std::deque<TxEntry> _tx_queue;
+    bool _tx_flushing = false;  // A flush is posted or waiting for the socket, it owns the queue head
+    size_t _tx_high_water = 0;
+    bool _tx_above_high_water = false;
+    CanTxHighWaterHandler _tx_high_water_cb;
+    // Only touched by the flush
+    std::array<mmsghdr, TX_BATCH> _tx_msgs{};
+    std::array<iovec, TX_BATCH> _tx_iov{};
+    std::vector<CanSendHandler> _tx_done;
+    boost::asio::steady_timer _tx_retry_timer;
+    std::chrono::milliseconds _tx_retry_delay = TX_RETRY_MIN;
 };
 
 int CanImpl::create_can_socket(const std::string& can_device_name) {
@@ -89,7 +180,7 @@ int CanImpl::create_can_socket(const std::string& can_device_name) {
 }
 
 CanImpl::CanImpl(boost::asio::io_context& io_ctx, const std::string& can_device_name)
-    : _can_stream(io_ctx) {
+    : _io_ctx(io_ctx), _can_stream(io_ctx), _executor(io_ctx), _rx_retry_timer(io_ctx), _tx_retry_timer(io_ctx) {
 
     int can_fd = create_can_socket(can_device_name);
 
@@ -97,7 +188,7 @@ CanImpl::CanImpl(boost::asio::io_context& io_ctx, const std::string& can_device_
 }
 
 CanImpl::CanImpl(boost::asio::io_context& io_ctx, int socket)
-    : _can_stream(io_ctx) {
+    : _io_ctx(io_ctx), _can_stream(io_ctx), _executor(io_ctx), _rx_retry_timer(io_ctx), _tx_retry_timer(io_ctx) {
 
     _can_stream.assign(socket);
 }
@@ -107,69 +198,513 @@ CanImpl::~CanImpl() {
 }
 
 void CanImpl::async_read(CanReadHandler&& can_read_handler) {
-    async_read_internal([self = shared_from_this(), can_read_handler](auto err, auto bt, auto frame) {
-        std::dynamic_pointer_cast<CanImpl>(self)->handle_read(err, bt, frame, can_read_handler);
-    });
+    auto frame = std::allocate_shared<canfd_frame>(RecyclingAllocator<canfd_frame>());
+    _can_stream.async_read_some(
+        boost::asio::buffer(frame.get(), sizeof(canfd_frame)),
+        boost::asio::bind_executor(_executor, with_recycling_allocator(
+            [self = std::static_pointer_cast<CanImpl>(shared_from_this()), frame,
+             can_read_handler = std::move(can_read_handler)](auto err, auto bt) {
+                if (self->check_read(err, bt)) {
+                    can_read_handler(*frame);
+                }
+            })));
 }
 
-void CanImpl::async_read_internal(async_read_internal_handler_t&& h) {
-    std::shared_ptr<canfd_frame> frame(new canfd_frame());
-    boost::asio::async_read(_can_stream, boost::asio::buffer(frame.get(), sizeof(canfd_frame)),
-                            [h, frame](auto err, auto bt) {
-                                assert(frame != nullptr);
-                                h(err, bt, *frame);
-                            });
+void CanImpl::async_send(const canfd_frame& cf, const CanSendHandler& handler) {
+    bool start_flush = false;
+    {
+        std::lock_guard<std::mutex> lock(_tx_mutex);
+        _tx_queue.push_back({cf, handler});
+        start_flush = !std::exchange(_tx_flushing, true);
+        if (_tx_high_water && !_tx_above_high_water && _tx_queue.size() >= _tx_high_water) {
+            _tx_above_high_water = true;
+            post_high_water(true);
+        }
+    }
+    if (start_flush) {
+        post_flush_tx();
+    }
 }
 
-void CanImpl::async_send(const canfd_frame& cf, const CanSendHandler& handler) {
-    boost::asio::async_write(_can_stream, boost::asio::buffer(&cf, sizeof(cf)),
-                             [self = shared_from_this(), handler](auto err, auto bt) {
-                                 std::dynamic_pointer_cast<CanImpl>(self)->handle_write(err, bt, handler);
-                             });
+size_t CanImpl::tx_queue_depth() const {
+    std::lock_guard<std::mutex> lock(_tx_mutex);
+    return _tx_queue.size();
 }
 
-void CanImpl::handle_read(const boost::system::error_code& err, std::size_t bytes_transferred,
-                                const canfd_frame& frame, const CanReadHandler& can_read_handler) {
-    if (err != boost::system::errc::success) {
-        if (err == boost::system::errc::operation_canceled) {
-            LOG_WARN(L_ASIOUTIL, "Operation cancelled, CAN socket");
-        } else if (err) {
-            LOG_WARN(L_ASIOUTIL, "Failed to read from CAN error={}, explanation={}", err.value(), err.message());
-            if (bytes_transferred < sizeof(canfd_frame)) {
-                LOG_WARN(L_ASIOUTIL, "Read incomplete CAN FD frame read={} expected={}", bytes_transferred,
-                                   sizeof(canfd_frame));
-            }
+void CanImpl::set_tx_high_water_mark(size_t mark, CanTxHighWaterHandler&& handler) {
+    std::lock_guard<std::mutex> lock(_tx_mutex);
+    _tx_high_water       = mark;
+    _tx_high_water_cb    = std::move(handler);
+    _tx_above_high_water = false;
+}
+
+// Called with _tx_mutex held, so both edges are posted in the order the queue crossed them
+void CanImpl::post_high_water(bool above) {
+    if (_tx_high_water_cb) {
+        boost::asio::post(_executor, with_recycling_allocator([handler = _tx_high_water_cb, above]() {
+                              handler(above);
+                          }));
+    }
+}
+
+void CanImpl::post_flush_tx() {
+    boost::asio::post(_executor, with_recycling_allocator([self = std::static_pointer_cast<CanImpl>(shared_from_this())]() {
+                          self->flush_tx();
+                      }));
+}
+
+// Classic frames go out CAN_MTU sized, with CANFD_MTU the kernel sends them as FD frames and
+// classic only interfaces reject them
+static size_t frame_mtu(const canfd_frame& frame) {
+    uint8_t fd_flags = CANFD_BRS;
+#ifdef CANFD_FDF
+    fd_flags |= CANFD_FDF;
+#endif
+    return frame.len <= CAN_MAX_DLEN && !(frame.flags & fd_flags) ? CAN_MTU : CANFD_MTU;
+}
+
+// Only one flush runs at a time, entries stay queued until the kernel took them
+void CanImpl::flush_tx() {
+    size_t count = 0;
+    {
+        // deque keeps references to its elements valid while other threads push_back
+        std::lock_guard<std::mutex> lock(_tx_mutex);
+        count = std::min(_tx_queue.size(), TX_BATCH);
+        for (size_t i = 0; i < count; i++) {
+            _tx_iov[i]                    = {&_tx_queue[i].frame, frame_mtu(_tx_queue[i].frame)};
+            _tx_msgs[i]                   = {};
+            _tx_msgs[i].msg_hdr.msg_iov    = &_tx_iov[i];
+            _tx_msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+        if (!count) {
+            _tx_flushing = false;
+            return;
         }
+    }
+
+    int sent = sendmmsg(_can_stream.native_handle(), _tx_msgs.data(), static_cast<unsigned>(count), MSG_DONTWAIT);
+    if (sent > 0) {
+        _tx_retry_delay = TX_RETRY_MIN;
+        tx_dequeued(sent, {});
+        post_flush_tx();
+        return;
+    }
+
+    int err = sent < 0 ? errno : EAGAIN;
+    if (err == EAGAIN || err == EWOULDBLOCK || err == EINTR) {
+        _can_stream.async_wait(boost::asio::posix::stream_descriptor::wait_write,
+                               boost::asio::bind_executor(_executor, with_recycling_allocator(
+                                   [self = std::static_pointer_cast<CanImpl>(shared_from_this())](auto) {
+                                       self->flush_tx();
+                                   })));
+    } else if (err == ENOBUFS) {
+        // The interface queue is full and CAN sockets don't report when it drains, back off and retry
+        LOG_DEBUG(L_CAN, "CAN transmit queue full, retry in {}ms", _tx_retry_delay.count());
+        _tx_retry_timer.expires_after(_tx_retry_delay);
+        _tx_retry_delay = std::min(_tx_retry_delay * 2, TX_RETRY_MAX);
+        _tx_retry_timer.async_wait(boost::asio::bind_executor(
+            _executor, with_recycling_allocator([self = std::static_pointer_cast<CanImpl>(shared_from_this())](auto) {
+                self->flush_tx();
+            })));
     } else {
-        can_read_handler(frame);
+        LOG_WARN(L_CAN, "Failed to send CAN frame error={}, explanation={}", err, strerror(err));
+        tx_dequeued(1, boost::system::error_code(err, boost::system::system_category()));
+        post_flush_tx();
     }
 }
 
-void CanImpl::handle_read_repeat(const boost::system::error_code& err, std::size_t bytes_transferred,
-                                       const canfd_frame& frame, const CanReadHandler& can_read_handler) {
-    handle_read(err, bytes_transferred, frame, can_read_handler);
+void CanImpl::tx_dequeued(size_t count, const boost::system::error_code& err) {
+    {
+        std::lock_guard<std::mutex> lock(_tx_mutex);
+        for (size_t i = 0; i < count; i++) {
+            _tx_done.push_back(std::move(_tx_queue.front().handler));
+            _tx_queue.pop_front();
+        }
+        if (_tx_above_high_water && _tx_queue.size() <= _tx_high_water / 2) {
+            _tx_above_high_water = false;
+            post_high_water(false);
+        }
+    }
 
-    async_read_internal([self = shared_from_this()](auto err, auto bt, auto frame) {
-        auto self_derived = std::dynamic_pointer_cast<CanImpl>(self);
-        self_derived->handle_read_repeat(err, bt, frame, self_derived->_can_read_cb);
-    });
+    for (auto& handler : _tx_done) {
+        if (handler) {
+            handler(err);
+        }
+    }
+    _tx_done.clear();
 }
 
-void CanImpl::handle_write(const boost::system::error_code& err, std::size_t /* bytes_transferred */,
-                                 const CanSendHandler& handler) {
-    if (handler) {
-        handler(err);
+// A read returns one frame, CAN_MTU sized for classic and CANFD_MTU sized for FD frames
+bool CanImpl::check_read(const boost::system::error_code& err, std::size_t bytes_transferred) {
+    if (err) {
+        if (err == boost::system::errc::operation_canceled) {
+            LOG_WARN(L_CAN, "Operation cancelled, CAN socket");
+        } else {
+            LOG_WARN(L_CAN, "Failed to read from CAN error={}, explanation={}", err.value(), err.message());
+        }
+        return false;
+    }
+    if (bytes_transferred != CANFD_MTU && bytes_transferred != CAN_MTU) {
+        LOG_WARN(L_CAN, "Dropping CAN frame of unexpected size {}", bytes_transferred);
+        return false;
     }
+    return true;
+}
+
+// The completion handler only carries self and the generation, the recycling allocator
+// reuses its memory, so the steady state loop doesn't allocate
+void CanImpl::async_read_repeat(std::shared_ptr<CanImpl> self, uint64_t generation) {
+    _can_stream.async_read_some(boost::asio::buffer(&_rx_frame, sizeof(_rx_frame)),
+                                boost::asio::bind_executor(_executor, with_recycling_allocator(
+                                    [self = std::move(self), generation](auto err, auto bt) mutable {
+                                        auto impl = self.get();
+                                        impl->handle_read_repeat(err, bt, std::move(self), generation);
+                                    })));
+}
+
+void CanImpl::handle_read_repeat(const boost::system::error_code& err, std::size_t bytes_transferred,
+                                 std::shared_ptr<CanImpl> self, uint64_t generation) {
+    // Replaced by a later registration
+    if (generation != _read_generation) {
+        return;
+    }
+    if (check_read(err, bytes_transferred)) {
+        if (_can_read_cb) {
+            _can_read_cb(_rx_frame);
+        }
+        dispatch(_rx_frame);
+    }
+
+    if (err == boost::asio::error::operation_aborted || err == boost::asio::error::eof ||
+        err == boost::asio::error::bad_descriptor || generation != _read_generation) {
+        return;
+    }
+    async_read_repeat(std::move(self), generation);
 }
 
 void CanImpl::register_read_callback(CanReadHandler&& can_read_handler) {
     _can_stream.cancel();
     _can_read_cb = std::move(can_read_handler);
+    async_read_repeat(std::static_pointer_cast<CanImpl>(shared_from_this()), ++_read_generation);
+}
+
+void CanImpl::register_batch_read_callback(CanBatchReadHandler&& can_batch_read_handler, size_t max_batch) {
+    _can_batch_read_cb       = std::move(can_batch_read_handler);
+    _can_timestamped_read_cb = nullptr;
+    start_batch_read(max_batch);
+}
+
+void CanImpl::register_timestamped_read_callback(CanTimestampedReadHandler&& handler, size_t max_batch) {
+    _can_timestamped_read_cb = std::move(handler);
+    _can_batch_read_cb       = nullptr;
+    start_batch_read(max_batch);
+}
+
+void CanImpl::start_batch_read(size_t max_batch) {
+    _can_stream.cancel();
+    uint64_t generation = ++_read_generation;
+
+    max_batch = std::max<size_t>(max_batch, 1);
+    _batch_frames.resize(max_batch);
+    _batch_iov.resize(max_batch);
+    _batch_msgs.assign(max_batch, mmsghdr{});
+    _batch_control.resize(max_batch);
+    _batch_timestamps.resize(max_batch);
+    for (size_t i = 0; i < max_batch; i++) {
+        _batch_iov[i]                    = {&_batch_frames[i], sizeof(canfd_frame)};
+        _batch_msgs[i].msg_hdr.msg_iov    = &_batch_iov[i];
+        _batch_msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    // Frames queued before now raise no new readiness event, drain them first
+    boost::asio::post(_executor, with_recycling_allocator(
+                                     [self = std::static_pointer_cast<CanImpl>(shared_from_this()), generation]() {
+                                         self->handle_batch_read({}, generation);
+                                     }));
+}
+
+void CanImpl::async_wait_batch(uint64_t generation) {
+    _can_stream.async_wait(boost::asio::posix::stream_descriptor::wait_read,
+                           boost::asio::bind_executor(_executor, with_recycling_allocator(
+                               [self = std::static_pointer_cast<CanImpl>(shared_from_this()), generation](auto err) {
+                                   self->handle_batch_read(err, generation);
+                               })));
+}
+
+void CanImpl::handle_batch_read(const boost::system::error_code& err, uint64_t generation) {
+    if (generation != _read_generation) {
+        return;
+    }
+    if (err) {
+        if (err == boost::system::errc::operation_canceled) {
+            LOG_WARN(L_CAN, "Operation cancelled, CAN socket");
+        } else {
+            LOG_WARN(L_CAN, "Failed to wait on CAN error={}, explanation={}", err.value(), err.message());
+        }
+        return;
+    }
+
+    // The kernel shrinks msg_controllen to what it wrote, give every message its full buffer back
+    for (size_t i = 0; i < _batch_msgs.size(); i++) {
+        _batch_msgs[i].msg_hdr.msg_control    = _rx_timestamps ? _batch_control[i].data : nullptr;
+        _batch_msgs[i].msg_hdr.msg_controllen = _rx_timestamps ? sizeof(_batch_control[i].data) : 0;
+    }
+
+    int n = recvmmsg(_can_stream.native_handle(), _batch_msgs.data(), static_cast<unsigned>(_batch_msgs.size()),
+                     MSG_DONTWAIT, nullptr);
+    if (n < 0) {
+        int read_err = errno;
+        if (read_err == ENETDOWN || read_err == ENOBUFS || read_err == ENOMEM) {
+            // Interface down or the kernel short of memory, the socket recovers on its own
+            LOG_RATE_LIMITED(1, L_CAN, asio::logger::LogLevel::WARN,
+                             "Failed to read from CAN error={}, explanation={}, retry in {}ms", read_err,
+                             strerror(read_err), _rx_retry_delay.count());
+            retry_batch_read(generation);
+            return;
+        }
+        if (read_err != EAGAIN && read_err != EWOULDBLOCK && read_err != EINTR) {
+            LOG_WARN(L_CAN, "Failed to read from CAN error={}, explanation={}", read_err, strerror(read_err));
+            return;
+        }
+        n = 0;
+    }
+    _rx_retry_delay = RX_RETRY_MIN;
+
+    size_t count = 0;
+    for (int i = 0; i < n; i++) {
+        auto bytes = _batch_msgs[i].msg_len;
+        if (bytes != CANFD_MTU && bytes != CAN_MTU) {
+            LOG_WARN(L_CAN, "Dropping CAN frame of unexpected size {}", bytes);
+            continue;
+        }
+        if (count != static_cast<size_t>(i)) {
+            _batch_frames[count] = _batch_frames[i];
+        }
+        _batch_timestamps[count] = _rx_timestamps ? parse_rx_timestamp(_batch_msgs[i].msg_hdr) : RxTimestamp{};
+        count++;
+    }
+    if (_rx_timestamps) {
+        for (size_t i = 0; i < count; i++) {
+            _rx_latency.record(_batch_timestamps[i]);
+        }
+    }
+    if (count && _can_batch_read_cb) {
+        _can_batch_read_cb(std::span<const canfd_frame>(_batch_frames.data(), count));
+    }
+    for (size_t i = 0; i < count && _can_timestamped_read_cb; i++) {
+        _can_timestamped_read_cb(_batch_frames[i], _batch_timestamps[i]);
+    }
+    for (size_t i = 0; i < count; i++) {
+        dispatch(_batch_frames[i]);
+    }
+
+    // A full batch may have left frames behind, the edge triggered reactor won't report them again
+    if (static_cast<size_t>(n) == _batch_msgs.size()) {
+        boost::asio::post(_executor, with_recycling_allocator(
+                                         [self = std::static_pointer_cast<CanImpl>(shared_from_this()), generation]() {
+                                             self->handle_batch_read({}, generation);
+                                         }));
+    } else {
+        async_wait_batch(generation);
+    }
+}
+
+void CanImpl::retry_batch_read(uint64_t generation) {
+    _rx_retry_timer.expires_after(_rx_retry_delay);
+    _rx_retry_delay = std::min(_rx_retry_delay * 2, RX_RETRY_MAX);
+    _rx_retry_timer.async_wait(boost::asio::bind_executor(
+        _executor, with_recycling_allocator(
+                       [self = std::static_pointer_cast<CanImpl>(shared_from_this()), generation](auto err) {
+                           if (err != boost::asio::error::operation_aborted) {
+                               self->handle_batch_read({}, generation);
+                           }
+                       })));
+}
+
+int CanImpl::set_filters(std::span<const can_filter> filters) {
+    if (setsockopt(_can_stream.native_handle(), SOL_CAN_RAW, CAN_RAW_FILTER, filters.data(),
+                   static_cast<socklen_t>(filters.size_bytes())) < 0) {
+        int err = errno;
+        LOG_WARN(L_CAN, "CAN_RAW_FILTER with {} filters can't be set: {}", filters.size(), strerror(err));
+        return err;
+    }
+    return 0;
+}
+
+int CanImpl::set_error_filter(can_err_mask_t mask) {
+    if (setsockopt(_can_stream.native_handle(), SOL_CAN_RAW, CAN_RAW_ERR_FILTER, &mask, sizeof(mask)) < 0) {
+        int err = errno;
+        LOG_WARN(L_CAN, "CAN_RAW_ERR_FILTER {:#x} can't be set: {}", mask, strerror(err));
+        return err;
+    }
+    return 0;
+}
+
+Can::SubscriptionId CanImpl::subscribe(canid_t can_id, CanReadHandler&& handler, canid_t mask) {
+    bool extended    = can_id & CAN_EFF_FLAG;
+    canid_t id_bits  = extended ? CAN_EFF_MASK : CAN_SFF_MASK;
+    auto subscription = std::make_unique<Subscription>(
+        Subscription{extended, can_id & mask & id_bits, mask & id_bits, std::move(handler)});
+
+    std::lock_guard<std::recursive_mutex> lock(_subscription_mutex);
+    if (!extended) {
+        if (!_sff_subscribers) {
+            _sff_subscribers = std::make_unique<std::array<SubscriptionList, CAN_SFF_MASK + 1>>();
+        }
+        for (canid_t id = 0; id <= CAN_SFF_MASK; id++) {
+            if ((id & subscription->mask) == subscription->can_id) {
+                (*_sff_subscribers)[id].push_back(subscription.get());
+            }
+        }
+    } else if (subscription->mask == CAN_EFF_MASK) {
+        _eff_subscribers[subscription->can_id].push_back(subscription.get());
+    } else {
+        _eff_masked_subscribers.push_back(subscription.get());
+    }
+
+    SubscriptionId id = _next_subscription++;
+    _subscriptions.emplace(id, std::move(subscription));
+    if (!_read_generation) {
+        register_read_callback(nullptr);
+    }
+    return id;
+}
+
+void CanImpl::unsubscribe(SubscriptionId id) {
+    std::lock_guard<std::recursive_mutex> lock(_subscription_mutex);
+    auto it = _subscriptions.find(id);
+    if (it == _subscriptions.end()) {
+        return;
+    }
+    // Lists can't change under a dispatch, the entry is removed once it's done
+    if (_dispatching) {
+        it->second->handler = nullptr;
+        _pending_unsubscribe.push_back(id);
+        return;
+    }
+    remove_subscription(id);
+}
+
+void CanImpl::remove_subscription(SubscriptionId id) {
+    auto it = _subscriptions.find(id);
+    if (it == _subscriptions.end()) {
+        return;
+    }
+    Subscription* subscription = it->second.get();
+    if (!subscription->extended) {
+        for (auto& subscribers : *_sff_subscribers) {
+            std::erase(subscribers, subscription);
+        }
+    } else if (subscription->mask == CAN_EFF_MASK) {
+        auto entry = _eff_subscribers.find(subscription->can_id);
+        std::erase(entry->second, subscription);
+        if (entry->second.empty()) {
+            _eff_subscribers.erase(entry);
+        }
+    } else {
+        std::erase(_eff_masked_subscribers, subscription);
+    }
+    _subscriptions.erase(it);
+}
+
+void CanImpl::dispatch(const canfd_frame& frame) {
+    if (frame.can_id & CAN_ERR_FLAG) {
+        return;
+    }
+    std::lock_guard<std::recursive_mutex> lock(_subscription_mutex);
+    if (_subscriptions.empty()) {
+        return;
+    }
+
+    _dispatching = true;
+    if (frame.can_id & CAN_EFF_FLAG) {
+        canid_t id = frame.can_id & CAN_EFF_MASK;
+        if (auto it = _eff_subscribers.find(id); it != _eff_subscribers.end()) {
+            call_subscribers(it->second, frame);
+        }
+        for (size_t i = 0; i < _eff_masked_subscribers.size(); i++) {
+            auto* subscription = _eff_masked_subscribers[i];
+            if ((id & subscription->mask) == subscription->can_id && subscription->handler) {
+                subscription->handler(frame);
+            }
+        }
+    } else if (_sff_subscribers) {
+        call_subscribers((*_sff_subscribers)[frame.can_id & CAN_SFF_MASK], frame);
+    }
+    _dispatching = false;
+
+    for (auto id : _pending_unsubscribe) {
+        remove_subscription(id);
+    }
+    _pending_unsubscribe.clear();
+}
+
+// Indexed, handlers may subscribe more and so grow the list
+void CanImpl::call_subscribers(const SubscriptionList& subscribers, const canfd_frame& frame) {
+    for (size_t i = 0; i < subscribers.size(); i++) {
+        if (subscribers[i]->handler) {
+            subscribers[i]->handler(frame);
+        }
+    }
+}
+
+boost::asio::awaitable<canfd_frame> CanImpl::async_read_frame() {
+    canfd_frame frame = {};
+    for (;;) {
+        auto bytes = co_await _can_stream.async_read_some(boost::asio::buffer(&frame, sizeof(frame)),
+                                                          boost::asio::use_awaitable);
+        if (bytes == CANFD_MTU || bytes == CAN_MTU) {
+            co_return frame;
+        }
+        LOG_WARN(L_CAN, "Dropping CAN frame of unexpected size {}", bytes);
+    }
+}
+
+boost::asio::awaitable<void> CanImpl::async_send_frame(const canfd_frame& frame) {
+    // Keep the frame in the coroutine frame, the caller's copy may be gone after the first suspension
+    canfd_frame cf = frame;
+    co_await boost::asio::async_initiate<decltype(boost::asio::use_awaitable), void(boost::system::error_code)>(
+        [this, &cf](auto handler) {
+            // CanSendHandler must be copyable, the awaitable's handler is move-only
+            auto shared = std::make_shared<decltype(handler)>(std::move(handler));
+            async_send(cf, [this, shared](const boost::system::error_code& err) {
+                auto executor = boost::asio::get_associated_executor(*shared, _io_ctx.get_executor());
+                boost::asio::post(executor, [shared, err]() { (*shared)(err); });
+            });
+        },
+        boost::asio::use_awaitable);
+}
+
+int CanImpl::set_busy_poll(std::chrono::microseconds budget) {
+    int usec = static_cast<int>(budget.count());
+    if (setsockopt(_can_stream.native_handle(), SOL_SOCKET, SO_BUSY_POLL, &usec, sizeof(usec)) < 0) {
+        int err = errno;
+        LOG_WARN(L_CAN, "CAN SO_BUSY_POLL {}us can't be set: {}", usec, strerror(err));
+        return err;
+    }
+    return 0;
+}
+
+int CanImpl::enable_rx_timestamps(bool hardware) {
+    int err = asio::utils::enable_rx_timestamps(_can_stream.native_handle(), hardware);
+    if (err) {
+        LOG_WARN(L_CAN, "CAN receive timestamps can't be enabled: {}", strerror(err));
+        return err;
+    }
+    _rx_timestamps = true;
+    return 0;
+}
+
+RxLatencyStats CanImpl::rx_latency_stats() const {
+    return _rx_latency.stats();
+}
+
+void CanImpl::reset_rx_latency_stats() {
+    _rx_latency.reset();
+}
 
-    async_read_internal([self = shared_from_this()](auto err, auto bt, auto frame) {
-        auto self_derived = std::dynamic_pointer_cast<CanImpl>(self);
-        self_derived->handle_read_repeat(err, bt, frame, self_derived->_can_read_cb);
-    });
+void CanImpl::set_priority(HandlerPriority priority) {
+    _executor = PriorityScheduler::executor(_io_ctx, priority);
 }
 
 }
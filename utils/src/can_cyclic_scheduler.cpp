@@ -0,0 +1,237 @@
+#include "can_cyclic_scheduler.hpp"
+
+#include "handler_allocator.hpp"
+#include "logger.hpp"
+#include <boost/asio.hpp>
+#include <cstring>
+#include <linux/can/bcm.h>
+#include <net/if.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <unordered_map>
+
+namespace asio::utils::can {
+
+class CanCyclicSchedulerImpl : public CanCyclicScheduler,
+                               public std::enable_shared_from_this<CanCyclicSchedulerImpl> {
+public:
+    CanCyclicSchedulerImpl(boost::asio::io_context& io_ctx, const std::string& can_device_name);
+    CanCyclicSchedulerImpl(boost::asio::io_context& io_ctx, int socket_fd);
+    ~CanCyclicSchedulerImpl() override;
+
+    int start_cyclic(const canfd_frame& frame, std::chrono::microseconds interval) override;
+    int update_payload(const canfd_frame& frame) override;
+    int stop_cyclic(canid_t can_id) override;
+    int watch(canid_t can_id, std::chrono::microseconds timeout, RxChangeHandler&& on_change,
+              RxTimeoutHandler&& on_timeout, bool fd_frames) override;
+    int unwatch(canid_t can_id) override;
+
+private:
+    // Head and a single frame, classic frames only use the first CAN_MTU bytes of it.
+    // bcm_msg_head ends in a flexible array, so it can't be a member itself
+    struct BcmMessage {
+        bcm_msg_head& head() { return *reinterpret_cast<bcm_msg_head*>(data); }
+        canfd_frame& frame() { return *reinterpret_cast<canfd_frame*>(data + sizeof(bcm_msg_head)); }
+
+        alignas(bcm_msg_head) std::byte data[sizeof(bcm_msg_head) + sizeof(canfd_frame)];
+    };
+
+    struct Watch {
+        RxChangeHandler on_change;
+        RxTimeoutHandler on_timeout;
+        bool fd_frames;
+    };
+
+    static int create_bcm_socket(const std::string& can_device_name);
+    int send_message(uint32_t opcode, uint32_t flags, canid_t can_id, std::chrono::microseconds ival1,
+                     std::chrono::microseconds ival2, const canfd_frame* frame, bool fd_frames);
+    void async_read();
+    void handle_read(const boost::system::error_code& err, std::size_t bytes_transferred);
+
+    boost::asio::posix::stream_descriptor _bcm_stream;
+    std::unordered_map<canid_t, bool> _tx_jobs;  // CAN_FD_FRAME setting of each cyclic job
+    std::unordered_map<canid_t, Watch> _watches;
+    BcmMessage _rx_message = {};
+    bool _reading = false;
+};
+
+static bcm_timeval to_bcm_timeval(std::chrono::microseconds interval) {
+    auto sec = std::chrono::duration_cast<std::chrono::seconds>(interval);
+    return {static_cast<long>(sec.count()), static_cast<long>((interval - sec).count())};
+}
+
+int CanCyclicSchedulerImpl::create_bcm_socket(const std::string& can_device_name) {
+    if (can_device_name.size() >= IFNAMSIZ) {
+        throw std::system_error(EINVAL, std::generic_category(),
+                                fmt::format("CAN device name too long: {}", can_device_name));
+    }
+
+    int s = socket(PF_CAN, SOCK_DGRAM | SOCK_CLOEXEC, CAN_BCM);
+    if (s < 0) {
+        throw std::system_error(errno, std::generic_category(), "CAN BCM socket can't be opened");
+    }
+
+    struct ifreq ifr = {};
+    strncpy(ifr.ifr_name, can_device_name.c_str(), can_device_name.size());
+    if (ioctl(s, SIOCGIFINDEX, &ifr) < 0) {
+        int err = errno;
+        close(s);
+        throw std::system_error(err, std::generic_category(),
+                                fmt::format("CAN Device: {} .. can't be opened", can_device_name));
+    }
+
+    struct sockaddr_can addr = {};
+    addr.can_family          = AF_CAN;
+    addr.can_ifindex         = ifr.ifr_ifindex;
+    if (connect(s, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) < 0) {
+        int err = errno;
+        close(s);
+        throw std::system_error(err, std::generic_category(),
+                                fmt::format("CAN BCM socket can't be connected to {}", can_device_name));
+    }
+    return s;
+}
+
+CanCyclicSchedulerImpl::CanCyclicSchedulerImpl(boost::asio::io_context& io_ctx, const std::string& can_device_name)
+    : _bcm_stream(io_ctx, create_bcm_socket(can_device_name)) {}
+
+CanCyclicSchedulerImpl::CanCyclicSchedulerImpl(boost::asio::io_context& io_ctx, int socket_fd)
+    : _bcm_stream(io_ctx, socket_fd) {}
+
+// Closing the socket makes the kernel drop every job and watch of it
+CanCyclicSchedulerImpl::~CanCyclicSchedulerImpl() {
+    _bcm_stream.close();
+}
+
+int CanCyclicSchedulerImpl::send_message(uint32_t opcode, uint32_t flags, canid_t can_id,
+                                         std::chrono::microseconds ival1, std::chrono::microseconds ival2,
+                                         const canfd_frame* frame, bool fd_frames) {
+    BcmMessage message = {};
+    auto& head         = message.head();
+    head.opcode        = opcode;
+    head.flags         = flags | (fd_frames ? CAN_FD_FRAME : 0);
+    head.can_id        = can_id;
+    head.ival1         = to_bcm_timeval(ival1);
+    head.ival2         = to_bcm_timeval(ival2);
+    head.nframes       = frame ? 1 : 0;
+    if (frame) {
+        message.frame() = *frame;
+    }
+
+    size_t size = sizeof(bcm_msg_head) + (frame ? (fd_frames ? CANFD_MTU : CAN_MTU) : 0);
+    if (write(_bcm_stream.native_handle(), message.data, size) < 0) {
+        int err = errno;
+        LOG_WARN(L_CAN, "CAN BCM opcode {} for {:#x} failed: {}", opcode, can_id, strerror(err));
+        return err;
+    }
+    return 0;
+}
+
+int CanCyclicSchedulerImpl::start_cyclic(const canfd_frame& frame, std::chrono::microseconds interval) {
+    bool fd_frames = frame.len > CAN_MAX_DLEN;
+    auto job       = _tx_jobs.find(frame.can_id);
+    if (job != _tx_jobs.end() && job->second != fd_frames) {
+        // The kernel keys jobs by CAN_FD_FRAME too, drop the one of the other kind
+        stop_cyclic(frame.can_id);
+    }
+
+    int err = send_message(TX_SETUP, SETTIMER | STARTTIMER, frame.can_id, {}, interval, &frame, fd_frames);
+    if (!err) {
+        _tx_jobs[frame.can_id] = fd_frames;
+    }
+    return err;
+}
+
+int CanCyclicSchedulerImpl::update_payload(const canfd_frame& frame) {
+    auto job = _tx_jobs.find(frame.can_id);
+    if (job == _tx_jobs.end()) {
+        return ENOENT;
+    }
+    // TX_SETUP without SETTIMER replaces the frame and leaves the running timer alone
+    return send_message(TX_SETUP, 0, frame.can_id, {}, {}, &frame, job->second);
+}
+
+int CanCyclicSchedulerImpl::stop_cyclic(canid_t can_id) {
+    auto job = _tx_jobs.find(can_id);
+    if (job == _tx_jobs.end()) {
+        return ENOENT;
+    }
+    int err = send_message(TX_DELETE, 0, can_id, {}, {}, nullptr, job->second);
+    _tx_jobs.erase(job);
+    return err;
+}
+
+int CanCyclicSchedulerImpl::watch(canid_t can_id, std::chrono::microseconds timeout, RxChangeHandler&& on_change,
+                                  RxTimeoutHandler&& on_timeout, bool fd_frames) {
+    // One mask frame with every payload bit relevant, any change of it is reported
+    canfd_frame mask = {};
+    mask.len         = fd_frames ? CANFD_MAX_DLEN : CAN_MAX_DLEN;
+    std::memset(mask.data, 0xff, mask.len);
+
+    uint32_t flags = RX_CHECK_DLC | (timeout.count() ? SETTIMER | STARTTIMER : 0);
+    int err        = send_message(RX_SETUP, flags, can_id, timeout, {}, &mask, fd_frames);
+    if (err) {
+        return err;
+    }
+
+    _watches[can_id] = {std::move(on_change), std::move(on_timeout), fd_frames};
+    if (!_reading) {
+        _reading = true;
+        async_read();
+    }
+    return 0;
+}
+
+int CanCyclicSchedulerImpl::unwatch(canid_t can_id) {
+    auto watch = _watches.find(can_id);
+    if (watch == _watches.end()) {
+        return ENOENT;
+    }
+    int err = send_message(RX_DELETE, 0, can_id, {}, {}, nullptr, watch->second.fd_frames);
+    _watches.erase(watch);
+    return err;
+}
+
+// A weak reference, so dropping the scheduler closes the socket and ends the jobs
+void CanCyclicSchedulerImpl::async_read() {
+    _bcm_stream.async_read_some(boost::asio::buffer(_rx_message.data),
+                                with_recycling_allocator([weak = weak_from_this()](auto err, auto bt) {
+                                    if (auto self = weak.lock()) {
+                                        self->handle_read(err, bt);
+                                    }
+                                }));
+}
+
+void CanCyclicSchedulerImpl::handle_read(const boost::system::error_code& err, std::size_t bytes_transferred) {
+    if (err) {
+        if (err != boost::asio::error::operation_aborted) {
+            LOG_WARN(L_CAN, "Failed to read from CAN BCM error={}, explanation={}", err.value(), err.message());
+        }
+        _reading = false;
+        return;
+    }
+
+    const auto& head = _rx_message.head();
+    auto watch       = _watches.find(head.can_id);
+    if (bytes_transferred >= sizeof(bcm_msg_head) && watch != _watches.end()) {
+        if (head.opcode == RX_CHANGED && head.nframes == 1 && watch->second.on_change) {
+            watch->second.on_change(_rx_message.frame());
+        } else if (head.opcode == RX_TIMEOUT && watch->second.on_timeout) {
+            watch->second.on_timeout(head.can_id);
+        }
+    }
+    async_read();
+}
+
+}
+
+std::shared_ptr<asio::utils::can::CanCyclicScheduler> asio::utils::can::CanCyclicScheduler::create(
+    boost::asio::io_context& io_ctx, const std::string& can_device_name) {
+    return std::make_shared<CanCyclicSchedulerImpl>(io_ctx, can_device_name);
+}
+
+std::shared_ptr<asio::utils::can::CanCyclicScheduler> asio::utils::can::CanCyclicScheduler::create(
+    boost::asio::io_context& io_ctx, int socket_fd) {
+    return std::make_shared<CanCyclicSchedulerImpl>(io_ctx, socket_fd);
+}
@@ -0,0 +1,120 @@
+#include "handler_allocator.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <mutex>
+#include <new>
+#include <vector>
+
+using namespace asio::utils;
+
+namespace {
+
+constexpr std::array<std::size_t, 5> SIZE_CLASSES = {64, 128, 256, 512, 1024};
+constexpr std::size_t CACHE_DEPTH                  = 32;
+
+struct ThreadCache;
+
+struct Registry {
+    std::mutex mutex;
+    std::vector<ThreadCache*> caches;
+    uint64_t retired_heap_allocations     = 0;
+    uint64_t retired_recycled_allocations = 0;
+};
+
+// Intentionally leaked, thread caches may unregister after static destruction started
+Registry& registry() {
+    static Registry* registry = new Registry();
+    return *registry;
+}
+
+struct ThreadCache {
+    ThreadCache() {
+        std::lock_guard<std::mutex> lock(registry().mutex);
+        registry().caches.push_back(this);
+    }
+
+    ~ThreadCache() {
+        for (std::size_t i = 0; i < SIZE_CLASSES.size(); i++) {
+            for (std::size_t j = 0; j < count[i]; j++) {
+                ::operator delete(blocks[i][j]);
+            }
+        }
+        // Handlers released later in this thread's teardown (other thread_locals, asio's own
+        // thread info) go straight to the heap
+        count.fill(0);
+        destroyed = true;
+
+        auto& r = registry();
+        std::lock_guard<std::mutex> lock(r.mutex);
+        r.retired_heap_allocations += heap_allocations.load(std::memory_order_relaxed);
+        r.retired_recycled_allocations += recycled_allocations.load(std::memory_order_relaxed);
+        r.caches.erase(std::find(r.caches.begin(), r.caches.end(), this));
+    }
+
+    // Only the owning thread writes, so a plain load/store pair is enough
+    static void increment(std::atomic<uint64_t>& counter) {
+        counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+    std::array<std::array<void*, CACHE_DEPTH>, SIZE_CLASSES.size()> blocks;
+    std::array<std::size_t, SIZE_CLASSES.size()> count{};
+    std::atomic<uint64_t> heap_allocations{0};
+    std::atomic<uint64_t> recycled_allocations{0};
+    bool destroyed = false;
+};
+
+thread_local ThreadCache t_cache;
+
+std::size_t size_class(std::size_t size) {
+    for (std::size_t i = 0; i < SIZE_CLASSES.size(); i++) {
+        if (size <= SIZE_CLASSES[i]) {
+            return i;
+        }
+    }
+    return SIZE_CLASSES.size();
+}
+
+}
+
+void* asio::utils::detail::allocate_handler_memory(std::size_t size) {
+    if (t_cache.destroyed) {
+        return ::operator new(size);
+    }
+    auto idx = size_class(size);
+    if (idx < SIZE_CLASSES.size() && t_cache.count[idx] > 0) {
+        ThreadCache::increment(t_cache.recycled_allocations);
+        return t_cache.blocks[idx][--t_cache.count[idx]];
+    }
+
+    ThreadCache::increment(t_cache.heap_allocations);
+    return ::operator new(idx < SIZE_CLASSES.size() ? SIZE_CLASSES[idx] : size);
+}
+
+void asio::utils::detail::deallocate_handler_memory(void* pointer, std::size_t size) noexcept {
+    if (t_cache.destroyed) {
+        ::operator delete(pointer);
+        return;
+    }
+    auto idx = size_class(size);
+    if (idx < SIZE_CLASSES.size() && t_cache.count[idx] < CACHE_DEPTH) {
+        t_cache.blocks[idx][t_cache.count[idx]++] = pointer;
+        return;
+    }
+    ::operator delete(pointer);
+}
+
+HandlerAllocatorStats asio::utils::handler_allocator_stats() {
+    auto& r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+
+    HandlerAllocatorStats stats;
+    stats.heap_allocations     = r.retired_heap_allocations;
+    stats.recycled_allocations = r.retired_recycled_allocations;
+    for (auto* cache : r.caches) {
+        stats.heap_allocations += cache->heap_allocations.load(std::memory_order_relaxed);
+        stats.recycled_allocations += cache->recycled_allocations.load(std::memory_order_relaxed);
+    }
+    return stats;
+}
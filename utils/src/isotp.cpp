@@ -0,0 +1,672 @@
+#include "isotp.hpp"
+
+#include "handler_allocator.hpp"
+#include "logger.hpp"
+#include <algorithm>
+#include <boost/asio.hpp>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <vector>
+
+// Older kernel headers lack it, the value is fixed by the kernel ABI
+#ifndef CANFD_FDF
+#define CANFD_FDF 0x04
+#endif
+
+namespace asio::utils::can {
+
+// Upper nibble of the first byte
+enum PciType : uint8_t {
+    SINGLE_FRAME      = 0x0,
+    FIRST_FRAME       = 0x1,
+    CONSECUTIVE_FRAME = 0x2,
+    FLOW_CONTROL      = 0x3,
+};
+
+enum FlowStatus : uint8_t {
+    CONTINUE_TO_SEND = 0x0,
+    WAIT             = 0x1,
+    OVERFLOW         = 0x2,
+};
+
+class IsoTpImpl : public IsoTp, public std::enable_shared_from_this<IsoTpImpl> {
+public:
+    IsoTpImpl(boost::asio::io_context& io_ctx, std::shared_ptr<Can> can, const IsoTpConfig& config);
+    ~IsoTpImpl() override;
+
+    int open_session(const IsoTpAddress& address, ReceiveHandler&& handler) override;
+    int close_session(const IsoTpAddress& address) override;
+    void async_send(const IsoTpAddress& address, std::span<const uint8_t> data, SendHandler&& handler) override;
+
+private:
+    // Single frames with the 4 bit length, classic first frames with the 12 bit length
+    static constexpr size_t SHORT_SINGLE_FRAME_MAX = 7;
+    static constexpr size_t SHORT_FIRST_FRAME_MAX  = 4095;
+    // Consecutive frames queued in one go before other handlers get a turn
+    static constexpr size_t TX_BURST = 64;
+
+    using Buffer     = std::vector<uint8_t>;
+    using SessionKey = std::pair<canid_t, canid_t>;
+
+    enum class TxState {
+        IDLE,
+        WAIT_FLOW_CONTROL,
+        SENDING,
+        FINISHING,  // Last frame queued, waiting for Can to take it
+    };
+
+    struct TxTransfer {
+        Buffer data;
+        SendHandler handler;
+    };
+
+    struct Session {
+        Session(boost::asio::io_context& io_ctx, const IsoTpAddress& address, ReceiveHandler&& handler)
+            : address(address), on_receive(std::move(handler)), tx_timer(io_ctx), rx_timer(io_ctx) {}
+
+        IsoTpAddress address;
+        ReceiveHandler on_receive;
+        Can::SubscriptionId subscription = 0;
+        bool closed                      = false;
+
+        std::deque<TxTransfer> tx_queue;
+        TxState tx_state      = TxState::IDLE;
+        uint64_t tx_transfer  = 0;  // Bumped when a transfer ends, Can completions of older ones are ignored
+        size_t tx_offset      = 0;
+        uint8_t tx_sequence   = 0;
+        uint8_t tx_block_size = 0;
+        uint8_t tx_block_left = 0;
+        std::chrono::microseconds tx_st_min{0};
+        unsigned tx_wait_frames = 0;
+        boost::asio::steady_timer tx_timer;  // N_Bs while waiting for flow control, STmin while sending
+        uint64_t tx_timer_wait = 0;          // Bumped by every arm and cancel, older completions are ignored
+
+        Buffer rx_buffer;
+        size_t rx_length      = 0;  // Zero when no multi frame message is being received
+        uint8_t rx_sequence   = 0;
+        uint8_t rx_block_left = 0;
+        std::chrono::steady_clock::time_point rx_last_frame;
+        boost::asio::steady_timer rx_timer;  // N_Cr, only re-armed when it expires
+    };
+    using SessionPtr = std::shared_ptr<Session>;
+
+    SessionPtr find_session(const IsoTpAddress& address);
+    void end_session(const SessionPtr& session);
+    void queue_transfer(const IsoTpAddress& address, Buffer&& buffer, SendHandler&& handler);
+
+    void handle_frame(const SessionPtr& session, const canfd_frame& frame);
+    void receive_single(const SessionPtr& session, const canfd_frame& frame);
+    void receive_first(const SessionPtr& session, const canfd_frame& frame);
+    void receive_consecutive(const SessionPtr& session, const canfd_frame& frame);
+    void receive_flow_control(const SessionPtr& session, const canfd_frame& frame);
+    void send_flow_control(const SessionPtr& session, FlowStatus status);
+    void abort_reception(const SessionPtr& session);
+    void arm_rx_timer(const SessionPtr& session, std::chrono::steady_clock::time_point expiry);
+
+    void start_transfer(const SessionPtr& session);
+    void send_consecutive(const SessionPtr& session);
+    void send_frame(const SessionPtr& session, const uint8_t* pci, size_t pci_len, const uint8_t* payload, size_t len,
+                    bool last);
+    void arm_tx_timer(const SessionPtr& session, std::chrono::microseconds duration);
+    void cancel_tx_timer(const SessionPtr& session);
+    void resume_transfer(const SessionPtr& session);
+    void finish_transfer(const SessionPtr& session, const boost::system::error_code& err);
+    void post_completion(SendHandler&& handler, const boost::system::error_code& err);
+
+    canfd_frame build_frame(canid_t can_id, const uint8_t* pci, size_t pci_len, const uint8_t* payload,
+                            size_t len) const;
+
+    Buffer acquire_buffer();
+    void release_buffer(Buffer&& buffer);
+
+    boost::asio::io_context& _io_ctx;
+    // Sessions, the buffer pool and every handler of this instance run here
+    boost::asio::strand<boost::asio::io_context::executor_type> _strand;
+    std::shared_ptr<Can> _can;
+    IsoTpConfig _config;
+    size_t _tx_dl;         // Frame size segmentation works with, 8 or 64
+    uint8_t _st_min_byte;  // _config.st_min as sent in flow control frames
+    std::mutex _sessions_mutex;  // Only the map, the public calls may come from any thread
+    std::map<SessionKey, SessionPtr> _sessions;
+    std::vector<Buffer> _buffer_pool;
+};
+
+static uint8_t encode_st_min(std::chrono::microseconds st_min) {
+    auto usec = st_min.count();
+    if (usec <= 0) {
+        return 0;
+    }
+    if (usec <= 900) {
+        return static_cast<uint8_t>(0xF0 + (usec + 99) / 100);
+    }
+    return static_cast<uint8_t>(std::min<int64_t>((usec + 999) / 1000, 0x7F));
+}
+
+static std::chrono::microseconds decode_st_min(uint8_t value) {
+    if (value <= 0x7F) {
+        return std::chrono::milliseconds(value);
+    }
+    if (value >= 0xF1 && value <= 0xF9) {
+        return std::chrono::microseconds((value - 0xF0) * 100);
+    }
+    // Reserved values are to be treated as the maximum
+    return std::chrono::milliseconds(0x7F);
+}
+
+// Smallest CAN FD data length holding len bytes
+static size_t fd_frame_length(size_t len) {
+    static constexpr uint8_t lengths[] = {12, 16, 20, 24, 32, 48, 64};
+    if (len <= CAN_MAX_DLEN) {
+        return len;
+    }
+    return *std::lower_bound(std::begin(lengths), std::end(lengths), len);
+}
+
+IsoTpImpl::IsoTpImpl(boost::asio::io_context& io_ctx, std::shared_ptr<Can> can, const IsoTpConfig& config)
+    : _io_ctx(io_ctx),
+      _strand(boost::asio::make_strand(io_ctx)),
+      _can(std::move(can)),
+      _config(config),
+      _tx_dl(config.fd ? CANFD_MAX_DLEN : CAN_MAX_DLEN),
+      _st_min_byte(encode_st_min(config.st_min)) {
+    if (!_can) {
+        throw std::system_error(EINVAL, std::generic_category(), "ISO-TP needs a Can instance");
+    }
+    // Sized for the common case up front, so steady state reassembly doesn't allocate
+    _buffer_pool.resize(_config.buffer_pool_size);
+    for (auto& buffer : _buffer_pool) {
+        buffer.reserve(std::min(_config.max_message_size, SHORT_FIRST_FRAME_MAX));
+    }
+}
+
+// No handler holds a reference anymore, so nothing runs on the strand concurrently
+IsoTpImpl::~IsoTpImpl() {
+    for (auto& [_, session] : _sessions) {
+        _can->unsubscribe(session->subscription);
+        end_session(session);
+    }
+}
+
+int IsoTpImpl::open_session(const IsoTpAddress& address, ReceiveHandler&& handler) {
+    std::lock_guard<std::mutex> lock(_sessions_mutex);
+    SessionKey key{address.tx_id, address.rx_id};
+    if (_sessions.count(key)) {
+        return EEXIST;
+    }
+    for (const auto& [_, session] : _sessions) {
+        if (session->address.rx_id == address.rx_id) {
+            return EADDRINUSE;
+        }
+    }
+
+    auto session = std::make_shared<Session>(_io_ctx, address, std::move(handler));
+    // Runs on the Can read loop's thread, the frame moves over to the strand
+    session->subscription = _can->subscribe(
+        address.rx_id, [strand = _strand, self = weak_from_this(), weak = std::weak_ptr<Session>(session)](
+                           const canfd_frame& frame) {
+            boost::asio::dispatch(strand, with_recycling_allocator([self, weak, frame]() {
+                                      auto isotp   = self.lock();
+                                      auto session = weak.lock();
+                                      if (isotp && session && !session->closed) {
+                                          isotp->handle_frame(session, frame);
+                                      }
+                                  }));
+        });
+    _sessions.emplace(key, std::move(session));
+    return 0;
+}
+
+int IsoTpImpl::close_session(const IsoTpAddress& address) {
+    SessionPtr session;
+    {
+        std::lock_guard<std::mutex> lock(_sessions_mutex);
+        auto it = _sessions.find({address.tx_id, address.rx_id});
+        if (it == _sessions.end()) {
+            return ENOENT;
+        }
+        session = std::move(it->second);
+        _sessions.erase(it);
+    }
+
+    _can->unsubscribe(session->subscription);
+    boost::asio::dispatch(_strand, [self = shared_from_this(), session]() { self->end_session(session); });
+    return 0;
+}
+
+void IsoTpImpl::async_send(const IsoTpAddress& address, std::span<const uint8_t> data, SendHandler&& handler) {
+    if (data.empty() || data.size() > UINT32_MAX) {
+        post_completion(std::move(handler), boost::asio::error::invalid_argument);
+        return;
+    }
+    if (_strand.running_in_this_thread()) {
+        auto buffer = acquire_buffer();
+        buffer.assign(data.begin(), data.end());
+        queue_transfer(address, std::move(buffer), std::move(handler));
+        return;
+    }
+    // The pool belongs to the strand, a call from outside copies into a buffer of its own
+    boost::asio::post(_strand, [self = shared_from_this(), address, buffer = Buffer(data.begin(), data.end()),
+                                handler = std::move(handler)]() mutable {
+        self->queue_transfer(address, std::move(buffer), std::move(handler));
+    });
+}
+
+IsoTpImpl::SessionPtr IsoTpImpl::find_session(const IsoTpAddress& address) {
+    std::lock_guard<std::mutex> lock(_sessions_mutex);
+    auto it = _sessions.find({address.tx_id, address.rx_id});
+    return it == _sessions.end() ? nullptr : it->second;
+}
+
+void IsoTpImpl::end_session(const SessionPtr& session) {
+    session->closed = true;
+    cancel_tx_timer(session);
+    abort_reception(session);
+    for (auto& transfer : session->tx_queue) {
+        release_buffer(std::move(transfer.data));
+        post_completion(std::move(transfer.handler), boost::asio::error::operation_aborted);
+    }
+    session->tx_queue.clear();
+    session->tx_state = TxState::IDLE;
+    session->tx_transfer++;
+}
+
+void IsoTpImpl::queue_transfer(const IsoTpAddress& address, Buffer&& buffer, SendHandler&& handler) {
+    auto session = find_session(address);
+    if (!session || session->closed) {
+        release_buffer(std::move(buffer));
+        post_completion(std::move(handler), boost::asio::error::not_found);
+        return;
+    }
+    session->tx_queue.push_back({std::move(buffer), std::move(handler)});
+    start_transfer(session);
+}
+
+void IsoTpImpl::handle_frame(const SessionPtr& session, const canfd_frame& frame) {
+    if (!frame.len) {
+        return;
+    }
+    switch (frame.data[0] >> 4) {
+    case SINGLE_FRAME:
+        receive_single(session, frame);
+        break;
+    case FIRST_FRAME:
+        receive_first(session, frame);
+        break;
+    case CONSECUTIVE_FRAME:
+        receive_consecutive(session, frame);
+        break;
+    case FLOW_CONTROL:
+        receive_flow_control(session, frame);
+        break;
+    default:
+        LOG_DEBUG(L_CAN, "ISO-TP {:#x}: ignoring frame of unknown type {:#x}", frame.can_id, frame.data[0]);
+        break;
+    }
+}
+
+void IsoTpImpl::receive_single(const SessionPtr& session, const canfd_frame& frame) {
+    size_t length = frame.data[0] & 0x0F;
+    size_t offset = 1;
+    if (!length && frame.len > CAN_MAX_DLEN) {
+        // CAN FD escape, the length moves to the second byte
+        length = frame.data[1];
+        offset = 2;
+    }
+    if (!length || offset + length > frame.len) {
+        LOG_DEBUG(L_CAN, "ISO-TP {:#x}: ignoring malformed single frame", frame.can_id);
+        return;
+    }
+    if (session->rx_length) {
+        LOG_WARN(L_CAN, "ISO-TP {:#x}: single frame interrupted a message of {} bytes", frame.can_id,
+                 session->rx_length);
+        abort_reception(session);
+    }
+    session->on_receive(std::span<const uint8_t>(frame.data + offset, length));
+}
+
+void IsoTpImpl::receive_first(const SessionPtr& session, const canfd_frame& frame) {
+    if (frame.len < 2) {
+        return;
+    }
+    size_t length = (static_cast<size_t>(frame.data[0] & 0x0F) << 8) | frame.data[1];
+    size_t offset = 2;
+    if (!length) {
+        // Escape for messages over 4095 bytes, a 32 bit big endian length follows
+        if (frame.len < 6) {
+            return;
+        }
+        length = (static_cast<size_t>(frame.data[2]) << 24) | (static_cast<size_t>(frame.data[3]) << 16) |
+                 (static_cast<size_t>(frame.data[4]) << 8) | frame.data[5];
+        offset = 6;
+    }
+    if (length <= frame.len - offset) {
+        LOG_DEBUG(L_CAN, "ISO-TP {:#x}: ignoring first frame of a single frame sized message", frame.can_id);
+        return;
+    }
+    if (session->rx_length) {
+        LOG_WARN(L_CAN, "ISO-TP {:#x}: first frame interrupted a message of {} bytes", frame.can_id,
+                 session->rx_length);
+        abort_reception(session);
+    }
+    if (length > _config.max_message_size) {
+        LOG_WARN(L_CAN, "ISO-TP {:#x}: rejecting message of {} bytes", frame.can_id, length);
+        send_flow_control(session, OVERFLOW);
+        return;
+    }
+
+    session->rx_buffer = acquire_buffer();
+    session->rx_buffer.reserve(length);
+    session->rx_buffer.assign(frame.data + offset, frame.data + frame.len);
+    session->rx_length     = length;
+    session->rx_sequence   = 1;
+    session->rx_block_left = _config.block_size;
+    session->rx_last_frame = std::chrono::steady_clock::now();
+    send_flow_control(session, CONTINUE_TO_SEND);
+    arm_rx_timer(session, session->rx_last_frame + _config.timeout);
+}
+
+void IsoTpImpl::receive_consecutive(const SessionPtr& session, const canfd_frame& frame) {
+    if (!session->rx_length) {
+        LOG_DEBUG(L_CAN, "ISO-TP {:#x}: ignoring unexpected consecutive frame", frame.can_id);
+        return;
+    }
+    if ((frame.data[0] & 0x0F) != session->rx_sequence) {
+        LOG_WARN(L_CAN, "ISO-TP {:#x}: consecutive frame {} where {} was expected, dropping message", frame.can_id,
+                 frame.data[0] & 0x0F, session->rx_sequence);
+        abort_reception(session);
+        return;
+    }
+    session->rx_sequence   = (session->rx_sequence + 1) & 0x0F;
+    session->rx_last_frame = std::chrono::steady_clock::now();
+
+    auto& buffer = session->rx_buffer;
+    size_t len   = std::min<size_t>(frame.len - 1, session->rx_length - buffer.size());
+    buffer.insert(buffer.end(), frame.data + 1, frame.data + 1 + len);
+    if (buffer.size() == session->rx_length) {
+        auto message       = std::move(buffer);
+        session->rx_length = 0;
+        session->rx_timer.cancel();
+        session->on_receive(message);
+        release_buffer(std::move(message));
+        return;
+    }
+
+    if (_config.block_size && !--session->rx_block_left) {
+        session->rx_block_left = _config.block_size;
+        send_flow_control(session, CONTINUE_TO_SEND);
+    }
+}
+
+void IsoTpImpl::receive_flow_control(const SessionPtr& session, const canfd_frame& frame) {
+    if (session->tx_state != TxState::WAIT_FLOW_CONTROL || frame.len < 3) {
+        LOG_DEBUG(L_CAN, "ISO-TP {:#x}: ignoring unexpected flow control", frame.can_id);
+        return;
+    }
+
+    switch (frame.data[0] & 0x0F) {
+    case CONTINUE_TO_SEND:
+        session->tx_block_size = frame.data[1];
+        session->tx_block_left = frame.data[1];
+        session->tx_st_min     = decode_st_min(frame.data[2]);
+        session->tx_state      = TxState::SENDING;
+        cancel_tx_timer(session);
+        send_consecutive(session);
+        break;
+    case WAIT:
+        if (++session->tx_wait_frames > _config.max_wait_frames) {
+            LOG_WARN(L_CAN, "ISO-TP {:#x}: peer sent more than {} wait frames", session->address.tx_id,
+                     _config.max_wait_frames);
+            finish_transfer(session, boost::asio::error::timed_out);
+        } else {
+            arm_tx_timer(session, _config.timeout);
+        }
+        break;
+    case OVERFLOW:
+        finish_transfer(session, boost::asio::error::message_size);
+        break;
+    default:
+        finish_transfer(session, boost::system::errc::make_error_code(boost::system::errc::protocol_error));
+        break;
+    }
+}
+
+void IsoTpImpl::send_flow_control(const SessionPtr& session, FlowStatus status) {
+    uint8_t pci[] = {static_cast<uint8_t>(FLOW_CONTROL << 4 | status), _config.block_size, _st_min_byte};
+    _can->async_send(build_frame(session->address.tx_id, pci, sizeof(pci), nullptr, 0),
+                     [can_id = session->address.tx_id](const boost::system::error_code& err) {
+                         if (err) {
+                             LOG_WARN(L_CAN, "ISO-TP {:#x}: flow control not sent: {}", can_id, err.message());
+                         }
+                     });
+}
+
+void IsoTpImpl::abort_reception(const SessionPtr& session) {
+    session->rx_length = 0;
+    session->rx_timer.cancel();
+    release_buffer(std::move(session->rx_buffer));
+    session->rx_buffer = {};
+}
+
+// Armed once per message and pushed out on expiry, instead of re-armed for every consecutive frame
+void IsoTpImpl::arm_rx_timer(const SessionPtr& session, std::chrono::steady_clock::time_point expiry) {
+    session->rx_timer.expires_at(expiry);
+    session->rx_timer.async_wait(boost::asio::bind_executor(
+        _strand, with_recycling_allocator([self = weak_from_this(), weak = std::weak_ptr<Session>(session)](
+                                              const boost::system::error_code& err) {
+            auto isotp   = self.lock();
+            auto session = weak.lock();
+            if (err || !isotp || !session || !session->rx_length) {
+                return;
+            }
+            auto deadline = session->rx_last_frame + isotp->_config.timeout;
+            if (deadline > std::chrono::steady_clock::now()) {
+                isotp->arm_rx_timer(session, deadline);
+                return;
+            }
+            LOG_WARN(L_CAN, "ISO-TP {:#x}: timed out after {} of {} bytes", session->address.rx_id,
+                     session->rx_buffer.size(), session->rx_length);
+            isotp->abort_reception(session);
+        })));
+}
+
+void IsoTpImpl::start_transfer(const SessionPtr& session) {
+    if (session->tx_state != TxState::IDLE || session->tx_queue.empty()) {
+        return;
+    }
+    const auto& data        = session->tx_queue.front().data;
+    session->tx_wait_frames = 0;
+
+    uint8_t pci[6];
+    if (data.size() <= (_config.fd ? _tx_dl - 2 : SHORT_SINGLE_FRAME_MAX)) {
+        size_t pci_len = 1;
+        if (data.size() <= SHORT_SINGLE_FRAME_MAX) {
+            pci[0] = static_cast<uint8_t>(SINGLE_FRAME << 4 | data.size());
+        } else {
+            pci[0]  = SINGLE_FRAME << 4;
+            pci[1]  = static_cast<uint8_t>(data.size());
+            pci_len = 2;
+        }
+        session->tx_state  = TxState::FINISHING;
+        session->tx_offset = data.size();
+        send_frame(session, pci, pci_len, data.data(), data.size(), true);
+        return;
+    }
+
+    size_t pci_len = 2;
+    if (data.size() <= SHORT_FIRST_FRAME_MAX) {
+        pci[0] = static_cast<uint8_t>(FIRST_FRAME << 4 | data.size() >> 8);
+        pci[1] = static_cast<uint8_t>(data.size());
+    } else {
+        pci[0] = FIRST_FRAME << 4;
+        pci[1] = 0;
+        for (size_t i = 0; i < 4; i++) {
+            pci[2 + i] = static_cast<uint8_t>(data.size() >> (24 - 8 * i));
+        }
+        pci_len = 6;
+    }
+    session->tx_offset   = _tx_dl - pci_len;
+    session->tx_sequence = 1;
+    session->tx_state    = TxState::WAIT_FLOW_CONTROL;
+    send_frame(session, pci, pci_len, data.data(), session->tx_offset, false);
+    arm_tx_timer(session, _config.timeout);
+}
+
+void IsoTpImpl::send_consecutive(const SessionPtr& session) {
+    const auto& data = session->tx_queue.front().data;
+    for (size_t burst = 0; burst < TX_BURST; burst++) {
+        size_t len  = std::min(_tx_dl - 1, data.size() - session->tx_offset);
+        bool last   = session->tx_offset + len == data.size();
+        uint8_t pci = static_cast<uint8_t>(CONSECUTIVE_FRAME << 4 | session->tx_sequence);
+        send_frame(session, &pci, 1, data.data() + session->tx_offset, len, last);
+        session->tx_offset += len;
+        session->tx_sequence = (session->tx_sequence + 1) & 0x0F;
+
+        if (last) {
+            session->tx_state = TxState::FINISHING;
+            return;
+        }
+        if (session->tx_block_size && !--session->tx_block_left) {
+            session->tx_state       = TxState::WAIT_FLOW_CONTROL;
+            session->tx_wait_frames = 0;
+            arm_tx_timer(session, _config.timeout);
+            return;
+        }
+        if (session->tx_st_min.count()) {
+            arm_tx_timer(session, session->tx_st_min);
+            return;
+        }
+    }
+
+    boost::asio::post(_strand,
+                      with_recycling_allocator([self = weak_from_this(), weak = std::weak_ptr<Session>(session),
+                                                transfer = session->tx_transfer]() {
+                          auto isotp   = self.lock();
+                          auto session = weak.lock();
+                          if (isotp && session && transfer == session->tx_transfer) {
+                              isotp->resume_transfer(session);
+                          }
+                      }));
+}
+
+void IsoTpImpl::send_frame(const SessionPtr& session, const uint8_t* pci, size_t pci_len, const uint8_t* payload,
+                           size_t len, bool last) {
+    // Completions run on the Can's executor, only the ones ending the transfer go to the strand
+    _can->async_send(build_frame(session->address.tx_id, pci, pci_len, payload, len),
+                     [strand = _strand, self = weak_from_this(), weak = std::weak_ptr<Session>(session),
+                      transfer = session->tx_transfer, last](const boost::system::error_code& err) {
+                         if (!err && !last) {
+                             return;
+                         }
+                         boost::asio::dispatch(strand, with_recycling_allocator([self, weak, transfer, err]() {
+                                                   auto isotp   = self.lock();
+                                                   auto session = weak.lock();
+                                                   if (isotp && session && transfer == session->tx_transfer) {
+                                                       isotp->finish_transfer(session, err);
+                                                   }
+                                               }));
+                     });
+}
+
+void IsoTpImpl::arm_tx_timer(const SessionPtr& session, std::chrono::microseconds duration) {
+    session->tx_timer.expires_after(duration);
+    session->tx_timer.async_wait(boost::asio::bind_executor(
+        _strand, with_recycling_allocator([self = weak_from_this(), weak = std::weak_ptr<Session>(session),
+                                           wait = ++session->tx_timer_wait](const boost::system::error_code& err) {
+            auto isotp   = self.lock();
+            auto session = weak.lock();
+            // A wait that already completed when it was cancelled still comes in without an error
+            if (!err && isotp && session && wait == session->tx_timer_wait) {
+                isotp->resume_transfer(session);
+            }
+        })));
+}
+
+void IsoTpImpl::cancel_tx_timer(const SessionPtr& session) {
+    session->tx_timer_wait++;
+    session->tx_timer.cancel();
+}
+
+// Expiry of the transfer's timer or the continuation of a burst
+void IsoTpImpl::resume_transfer(const SessionPtr& session) {
+    if (session->tx_state == TxState::WAIT_FLOW_CONTROL) {
+        LOG_WARN(L_CAN, "ISO-TP {:#x}: no flow control within {}ms", session->address.tx_id,
+                 _config.timeout.count());
+        finish_transfer(session, boost::asio::error::timed_out);
+    } else if (session->tx_state == TxState::SENDING) {
+        send_consecutive(session);
+    }
+}
+
+void IsoTpImpl::finish_transfer(const SessionPtr& session, const boost::system::error_code& err) {
+    auto transfer = std::move(session->tx_queue.front());
+    session->tx_queue.pop_front();
+    session->tx_transfer++;
+    session->tx_state = TxState::IDLE;
+    cancel_tx_timer(session);
+    release_buffer(std::move(transfer.data));
+
+    if (err) {
+        LOG_WARN(L_CAN, "ISO-TP {:#x}: send failed: {}", session->address.tx_id, err.message());
+    }
+    if (transfer.handler) {
+        transfer.handler(err);
+    }
+    if (!session->closed) {
+        start_transfer(session);
+    }
+}
+
+void IsoTpImpl::post_completion(SendHandler&& handler, const boost::system::error_code& err) {
+    if (handler) {
+        boost::asio::post(_strand, [handler = std::move(handler), err]() { handler(err); });
+    }
+}
+
+canfd_frame IsoTpImpl::build_frame(canid_t can_id, const uint8_t* pci, size_t pci_len, const uint8_t* payload,
+                                   size_t len) const {
+    canfd_frame frame = {};
+    frame.can_id      = can_id;
+    std::memcpy(frame.data, pci, pci_len);
+    if (len) {
+        std::memcpy(frame.data + pci_len, payload, len);
+    }
+
+    size_t used      = pci_len + len;
+    size_t frame_len = _config.pad_frames ? std::max<size_t>(used, CAN_MAX_DLEN) : used;
+    if (_config.fd) {
+        // FD frames can't have arbitrary lengths above 8, so they're always padded up to a valid one.
+        // CANFD_FDF makes Can send short ones as FD frames too
+        frame_len   = fd_frame_length(frame_len);
+        frame.flags = CANFD_FDF | (_config.bitrate_switch ? CANFD_BRS : 0);
+    }
+    // Classic frames stay within CAN_MAX_DLEN without FD flags, so Can writes them at CAN_MTU
+    std::memset(frame.data + used, _config.padding_byte, frame_len - used);
+    frame.len = static_cast<uint8_t>(frame_len);
+    return frame;
+}
+
+IsoTpImpl::Buffer IsoTpImpl::acquire_buffer() {
+    if (_buffer_pool.empty()) {
+        return {};
+    }
+    auto buffer = std::move(_buffer_pool.back());
+    _buffer_pool.pop_back();
+    buffer.clear();
+    return buffer;
+}
+
+void IsoTpImpl::release_buffer(Buffer&& buffer) {
+    if (buffer.capacity() && _buffer_pool.size() < _config.buffer_pool_size) {
+        _buffer_pool.push_back(std::move(buffer));
+    }
+}
+
+}
+
+std::shared_ptr<asio::utils::can::IsoTp> asio::utils::can::IsoTp::create(boost::asio::io_context& io_ctx,
+                                                                          std::shared_ptr<Can> can,
+                                                                          const IsoTpConfig& config) {
+    return std::make_shared<IsoTpImpl>(io_ctx, std::move(can), config);
+}
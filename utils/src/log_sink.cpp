@@ -0,0 +1,149 @@
+#include "log_sink.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <fmt/format.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <system_error>
+#include <unistd.h>
+
+using namespace asio::logger;
+
+static const char* levelNames[] = {"trace", "debug", "info", "warn", "error", "critical", "off"};
+
+const char* asio::logger::level_name(LogLevel level) {
+    auto idx = static_cast<size_t>(level);
+    return idx < std::size(levelNames) ? levelNames[idx] : "unknown";
+}
+
+void asio::logger::format_record(std::string& out, const LogRecord& record) {
+    auto since_epoch = record.timestamp.time_since_epoch();
+    auto seconds     = std::chrono::duration_cast<std::chrono::seconds>(since_epoch);
+    auto micros      = std::chrono::duration_cast<std::chrono::microseconds>(since_epoch - seconds);
+
+    std::time_t time = seconds.count();
+    std::tm tm       = {};
+    localtime_r(&time, &tm);
+
+    char time_buf[32];
+    std::strftime(time_buf, sizeof(time_buf), "%Y-%m-%d %H:%M:%S", &tm);
+
+    const char* basename = record.filename;
+    for (const char* p = record.filename; p && *p; p++) {
+        if (*p == '/') {
+            basename = p + 1;
+        }
+    }
+
+    out.clear();
+    fmt::format_to(std::back_inserter(out), "{}.{:06} [{}] [{}] {}:{} {}\n", time_buf, micros.count(),
+                   level_name(record.level), record.thread_id, basename ? basename : "", record.line_no,
+                   record.message);
+}
+
+void StdoutSink::write(const LogRecord& record) {
+    format_record(_line, record);
+    std::fwrite(_line.data(), 1, _line.size(), stdout);
+}
+
+void StdoutSink::flush() {
+    std::fflush(stdout);
+}
+
+FileSink::FileSink(const std::string& path) : _file(std::fopen(path.c_str(), "a")) {
+    if (!_file) {
+        throw std::system_error(errno, std::generic_category(), fmt::format("Log file {} can't be opened", path));
+    }
+}
+
+FileSink::~FileSink() {
+    std::fclose(_file);
+}
+
+void FileSink::write(const LogRecord& record) {
+    format_record(_line, record);
+    std::fwrite(_line.data(), 1, _line.size(), _file);
+}
+
+void FileSink::flush() {
+    std::fflush(_file);
+}
+
+MmapRingSink::MmapRingSink(const std::string& path, size_t size, size_t slot_size) {
+    slot_size           = (std::max<size_t>(slot_size, 64) + 7) & ~size_t(7);
+    uint64_t slot_count = std::max<size_t>(size / slot_size, 1);
+    _map_size           = MmapRingHeader::SIZE + slot_count * slot_size;
+
+    int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        throw std::system_error(errno, std::generic_category(), fmt::format("Log ring {} can't be opened", path));
+    }
+
+    struct stat st = {};
+    bool reuse     = fstat(fd, &st) == 0 && static_cast<size_t>(st.st_size) == _map_size;
+    if (!reuse && (ftruncate(fd, 0) < 0 || ftruncate(fd, _map_size) < 0)) {
+        int err = errno;
+        ::close(fd);
+        throw std::system_error(err, std::generic_category(), fmt::format("Log ring {} can't be resized", path));
+    }
+
+    void* map = mmap(nullptr, _map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    int err   = errno;
+    ::close(fd);
+    if (map == MAP_FAILED) {
+        throw std::system_error(err, std::generic_category(), fmt::format("Log ring {} can't be mapped", path));
+    }
+    _map    = static_cast<std::byte*>(map);
+    _header = reinterpret_cast<MmapRingHeader*>(_map);
+
+    if (reuse && _header->magic == MmapRingHeader::MAGIC && _header->version == MmapRingHeader::VERSION &&
+        _header->slot_size == slot_size && _header->slot_count == slot_count) {
+        // Continue after the newest slot, the output of the previous run stays readable
+        for (uint64_t i = 0; i < slot_count; i++) {
+            _next_seq = std::max(_next_seq, slot(i + 1)->seq + 1);
+        }
+        return;
+    }
+
+    std::memset(_map, 0, _map_size);
+    _header->version    = MmapRingHeader::VERSION;
+    _header->slot_size  = static_cast<uint32_t>(slot_size);
+    _header->slot_count = slot_count;
+    std::atomic_ref<uint64_t>(_header->magic).store(MmapRingHeader::MAGIC, std::memory_order_release);
+}
+
+MmapRingSink::~MmapRingSink() {
+    munmap(_map, _map_size);
+}
+
+MmapRingSlot* MmapRingSink::slot(uint64_t seq) {
+    size_t index = (seq - 1) % _header->slot_count;
+    return reinterpret_cast<MmapRingSlot*>(_map + MmapRingHeader::SIZE + index * _header->slot_size);
+}
+
+void MmapRingSink::write(const LogRecord& record) {
+    format_record(_line, record);
+
+    size_t text_size = _header->slot_size - sizeof(MmapRingSlot);
+    for (size_t offset = 0; offset < _line.size(); offset += text_size) {
+        MmapRingSlot* s = slot(_next_seq);
+        std::atomic_ref<uint64_t> seq(s->seq);
+
+        // A slot is only valid once seq is set again, so a write cut short by a crash gets skipped
+        seq.store(0, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        s->len   = static_cast<uint32_t>(std::min(text_size, _line.size() - offset));
+        s->flags = offset == 0 ? MmapRingSlot::FIRST : 0;
+        std::memcpy(s + 1, _line.data() + offset, s->len);
+        seq.store(_next_seq++, std::memory_order_release);
+    }
+}
+
+void MmapRingSink::flush() {
+    msync(_map, _map_size, MS_ASYNC);
+}
@@ -1,18 +1,734 @@
 #include "logger.hpp"
+#include "log_deferred.hpp"
+#include "log_sink.hpp"
+#include "string_util.hpp"
 
 #include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <cctype>
+#include <cerrno>
+#include <cstdlib>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <sys/syscall.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
 
 using namespace asio::logger;
+using asio::utils::stringUtil::append_hex;
 
-static const char* levelNames[] = {"trace", "debug", "info", "warn", "error", "critical", "off"};
+std::atomic<CategoryType> asio::logger::detail::level_masks[static_cast<size_t>(LogLevel::LEVEL_COUNT)];
 
+DEFINE_LOG_CATEGORY(L_ASIOUTIL, "AsioUtil");
+
+namespace {
+
+enum class RecordType : uint8_t { PADDING, MESSAGE, HEX, DEFERRED };
+
+struct RecordHeader {
+    uint32_t size;  // Whole record including this header, multiple of RECORD_ALIGN
+    RecordType type;
+    LogLevel level;
+    uint16_t title_len;
+    uint32_t line_no;
+    uint32_t payload_len;
+    CategoryType categories;
+    const char* filename;  // __FILE__ literals outlive every record
+    int64_t timestamp_nsec;
+};
+
+// Payload prefix of a DEFERRED record, the encoded arguments follow
+struct DeferredPrefix {
+    detail::DeferredFormatter formatter;
+    const char* format;  // Format string literal
+    size_t format_len;
+};
+
+constexpr size_t RECORD_ALIGN = alignof(RecordHeader);
+
+constexpr size_t align_up(size_t size) {
+    return (size + RECORD_ALIGN - 1) & ~(RECORD_ALIGN - 1);
+}
+
+/**
+ * Single producer, single consumer ring of variable sized records. The owning thread
+ * writes, the backend thread reads. A record never wraps, the space left at the end
+ * is skipped with a padding record instead.
+ */
+class ProducerRing {
+public:
+    ProducerRing(size_t capacity, uint64_t thread_id)
+        : _capacity(capacity), _mask(capacity - 1), _buffer(new std::byte[capacity]), _thread_id(thread_id) {}
+
+    // Largest record accepted, so a record always fits once the ring drained
+    size_t max_record_size() const { return _capacity / 4; }
+
+    // Room for a record of size bytes (multiple of RECORD_ALIGN) or nullptr if the ring
+    // is full. The backend sees the record after commit()
+    std::byte* try_reserve(size_t size) {
+        uint64_t head     = _head.load(std::memory_order_relaxed);
+        size_t pos        = head & _mask;
+        size_t contiguous = _capacity - pos;
+        size_t needed     = size <= contiguous ? size : contiguous + size;
+        if (_capacity - (head - _cached_tail) < needed) {
+            _cached_tail = _tail.load(std::memory_order_acquire);
+            if (_capacity - (head - _cached_tail) < needed) {
+                return nullptr;
+            }
+        }
+
+        if (size > contiguous) {
+            auto* padding = reinterpret_cast<RecordHeader*>(&_buffer[pos]);
+            padding->size = static_cast<uint32_t>(contiguous);
+            padding->type = RecordType::PADDING;
+            head += contiguous;
+            pos = 0;
+        }
+
+        _reserved_head = head + size;
+        return &_buffer[pos];
+    }
+
+    void commit() { _head.store(_reserved_head, std::memory_order_release); }
+
+    template <typename Function>
+    size_t consume(Function&& f) {
+        uint64_t tail = _tail.load(std::memory_order_relaxed);
+        uint64_t head = _head.load(std::memory_order_acquire);
+        size_t count  = 0;
+        while (tail != head) {
+            auto* header = reinterpret_cast<const RecordHeader*>(&_buffer[tail & _mask]);
+            if (header->type != RecordType::PADDING) {
+                f(*header, reinterpret_cast<const char*>(header + 1));
+                count++;
+            }
+            tail += header->size;
+        }
+        _tail.store(tail, std::memory_order_release);
+        return count;
+    }
+
+    uint64_t thread_id() const { return _thread_id; }
+
+    // Written by the owning thread only
+    std::atomic<uint64_t> dropped{0};
+    std::atomic<bool> closed{false};
+
+    // Backend thread only
+    uint64_t reported_dropped = 0;
+    bool retired              = false;  // Drained after its thread exited, safe to forget
+
+private:
+    const size_t _capacity;
+    const size_t _mask;
+    std::unique_ptr<std::byte[]> _buffer;
+    const uint64_t _thread_id;
+
+    alignas(64) std::atomic<uint64_t> _head{0};
+    uint64_t _cached_tail   = 0;
+    uint64_t _reserved_head = 0;
+    alignas(64) std::atomic<uint64_t> _tail{0};
+};
+
+size_t round_up_pow2(size_t size) {
+    size_t capacity = 4096;
+    while (capacity < size) {
+        capacity <<= 1;
+    }
+    return capacity;
+}
+
+std::string_view trim(std::string_view s) {
+    auto begin = s.find_first_not_of(" \t");
+    if (begin == std::string_view::npos) {
+        return {};
+    }
+    return s.substr(begin, s.find_last_not_of(" \t") - begin + 1);
+}
+
+std::optional<LogLevel> parse_level(std::string_view name) {
+    for (size_t i = 0; i <= static_cast<size_t>(LogLevel::OFF); i++) {
+        std::string_view expected = level_name(static_cast<LogLevel>(i));
+        if (std::equal(name.begin(), name.end(), expected.begin(), expected.end(),
+                       [](char a, char b) { return std::tolower(static_cast<unsigned char>(a)) == b; })) {
+            return static_cast<LogLevel>(i);
+        }
+    }
+    return std::nullopt;
+}
+
+class Backend {
+public:
+    static Backend& instance() {
+        // Intentionally leaked, threads may still log while static objects get destroyed
+        static Backend* backend = new Backend();
+        return *backend;
+    }
+
+    std::atomic<bool> active{false};
+    std::atomic<OverflowPolicy> overflow_policy{OverflowPolicy::DROP};
+
+    ProducerRing* register_thread();
+
+    void configure(const LoggerConfig& config);
+    CategoryType register_category(const char* name);
+    void set_level(LogLevel level);
+    LogLevel get_level();
+    void set_category_level(CategoryType category, LogLevel level);
+    void set_category_level(std::string_view name, LogLevel level);
+    std::optional<LogLevel> get_category_level(std::string_view name);
+    int set_category_levels(std::string_view spec);
+    void add_sink(std::shared_ptr<LogSink> sink);
+    void remove_sinks();
+    void flush();
+    void shutdown();
+    uint64_t dropped_records();
+
+private:
+    struct Category {
+        std::string name;
+        LogLevel level;
+    };
+
+    Backend();
+
+    void run();
+    size_t drain(const std::vector<std::shared_ptr<LogSink>>& sinks);
+    void set_active(bool is_active);
+    void set_level_locked(LogLevel level);
+    void set_category_level_locked(std::string_view name, LogLevel level);
+    int set_category_levels_locked(std::string_view spec);
+    void update_masks();
+    void write(const std::vector<std::shared_ptr<LogSink>>& sinks, const LogRecord& record);
+
+    std::mutex _mutex;
+    std::condition_variable _cv;
+    LoggerConfig _config;
+    LogLevel _level = LogLevel::INFO;
+    std::vector<Category> _categories;  // Index is the category bit
+    std::vector<Category> _pending_levels;  // Levels set for names that aren't registered yet
+    std::vector<std::shared_ptr<ProducerRing>> _rings;
+    std::vector<std::shared_ptr<LogSink>> _sinks;
+    uint64_t _config_version = 0;
+    uint64_t _retired_dropped = 0;
+    uint64_t _flush_requested = 0;
+    uint64_t _flush_done      = 0;
+    bool _stopping            = false;
+    std::thread _thread;
+
+    // Backend thread only
+    std::vector<std::shared_ptr<ProducerRing>> _drain_rings;
+    std::string _format_buf;
+};
+
+struct ThreadRing {
+    ~ThreadRing() {
+        if (ring) {
+            ring->closed = true;
+        }
+    }
+
+    std::shared_ptr<ProducerRing> ring;
+};
+
+thread_local ThreadRing t_ring;
+
+ProducerRing* Backend::register_thread() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    t_ring.ring = std::make_shared<ProducerRing>(round_up_pow2(_config.ring_buffer_size), syscall(SYS_gettid));
+    _rings.push_back(t_ring.ring);
+    _config_version++;
+    return t_ring.ring.get();
+}
+
+void Backend::configure(const LoggerConfig& config) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _config         = config;
+    overflow_policy = config.overflow_policy;
+}
+
+Backend::Backend() {
+    if (const char* spec = std::getenv("ASIO_UTILS_LOG_LEVELS")) {
+        set_category_levels_locked(spec);
+    }
+}
+
+CategoryType Backend::register_category(const char* name) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (size_t i = 0; i < _categories.size(); i++) {
+        if (_categories[i].name == name) {
+            return CategoryType(1) << i;
+        }
+    }
+    if (_categories.size() == sizeof(CategoryType) * 8) {
+        return 0;
+    }
+
+    LogLevel level = _level;
+    auto pending   = std::find_if(_pending_levels.begin(), _pending_levels.end(),
+                                  [&](const auto& category) { return category.name == name; });
+    if (pending != _pending_levels.end()) {
+        level = pending->level;
+        _pending_levels.erase(pending);
+    }
+    _categories.push_back({name, level});
+    update_masks();
+    return CategoryType(1) << (_categories.size() - 1);
+}
+
+void Backend::set_level(LogLevel level) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    set_level_locked(level);
+    update_masks();
+}
+
+LogLevel Backend::get_level() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _level;
+}
+
+void Backend::set_category_level(CategoryType category, LogLevel level) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (size_t i = 0; i < _categories.size(); i++) {
+        if (category & (CategoryType(1) << i)) {
+            _categories[i].level = level;
+        }
+    }
+    update_masks();
+}
+
+void Backend::set_category_level(std::string_view name, LogLevel level) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    set_category_level_locked(name, level);
+    update_masks();
+}
+
+std::optional<LogLevel> Backend::get_category_level(std::string_view name) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (const auto* categories : {&_categories, &_pending_levels}) {
+        for (const auto& category : *categories) {
+            if (category.name == name) {
+                return category.level;
+            }
+        }
+    }
+    return std::nullopt;
+}
+
+int Backend::set_category_levels(std::string_view spec) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return set_category_levels_locked(spec);
+}
+
+// The *_locked functions and update_masks() are called with _mutex held, or from the constructor
+void Backend::set_level_locked(LogLevel level) {
+    _level = level;
+    for (auto& category : _categories) {
+        category.level = level;
+    }
+    _pending_levels.clear();
+}
+
+void Backend::set_category_level_locked(std::string_view name, LogLevel level) {
+    for (auto* categories : {&_categories, &_pending_levels}) {
+        for (auto& category : *categories) {
+            if (category.name == name) {
+                category.level = level;
+                return;
+            }
+        }
+    }
+    _pending_levels.push_back({std::string(name), level});
+}
+
+int Backend::set_category_levels_locked(std::string_view spec) {
+    std::vector<Category> entries;
+    int ret = 0;
+    while (!spec.empty()) {
+        auto comma        = spec.find(',');
+        std::string_view entry = trim(spec.substr(0, comma));
+        spec              = comma == std::string_view::npos ? std::string_view() : spec.substr(comma + 1);
+        if (entry.empty()) {
+            continue;
+        }
+
+        auto equal = entry.find('=');
+        auto level = equal == std::string_view::npos ? std::nullopt : parse_level(trim(entry.substr(equal + 1)));
+        auto name  = trim(entry.substr(0, equal));
+        if (!level || name.empty()) {
+            ret = EINVAL;
+            break;
+        }
+        entries.push_back({std::string(name), *level});
+    }
+
+    // "*" first, so "CAN=trace,*=info" keeps CAN at trace
+    for (const auto& entry : entries) {
+        if (entry.name == "*") {
+            set_level_locked(entry.level);
+        }
+    }
+    for (const auto& entry : entries) {
+        if (entry.name != "*") {
+            set_category_level_locked(entry.name, entry.level);
+        }
+    }
+    update_masks();
+    return ret;
+}
+
+void Backend::update_masks() {
+    for (size_t level = 0; level < static_cast<size_t>(LogLevel::LEVEL_COUNT); level++) {
+        CategoryType mask = 0;
+        for (size_t i = 0; active && i < _categories.size(); i++) {
+            if (static_cast<size_t>(_categories[i].level) <= level) {
+                mask |= CategoryType(1) << i;
+            }
+        }
+        detail::level_masks[level].store(mask, std::memory_order_relaxed);
+    }
+}
+
+void Backend::set_active(bool is_active) {
+    active = is_active;
+    update_masks();
+}
+
+void Backend::add_sink(std::shared_ptr<LogSink> sink) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _sinks.push_back(std::move(sink));
+    _config_version++;
+    if (!_thread.joinable()) {
+        _stopping = false;
+        _thread   = std::thread([this]() { run(); });
+    }
+    set_active(true);
+}
+
+void Backend::remove_sinks() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    set_active(false);
+    _sinks.clear();
+    _config_version++;
+}
+
+void Backend::flush() {
+    std::unique_lock<std::mutex> lock(_mutex);
+    if (!_thread.joinable()) {
+        return;
+    }
+    uint64_t request = ++_flush_requested;
+    _cv.notify_all();
+    _cv.wait(lock, [&] { return _flush_done >= request || !_thread.joinable(); });
+}
+
+void Backend::shutdown() {
+    std::thread thread;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        set_active(false);
+        _stopping = true;
+        thread.swap(_thread);
+    }
+    _cv.notify_all();
+    if (thread.joinable()) {
+        thread.join();
+    }
+    _cv.notify_all();
+}
+
+uint64_t Backend::dropped_records() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    uint64_t dropped = _retired_dropped;
+    for (auto& ring : _rings) {
+        dropped += ring->dropped.load(std::memory_order_relaxed);
+    }
+    return dropped;
+}
+
+void Backend::write(const std::vector<std::shared_ptr<LogSink>>& sinks, const LogRecord& record) {
+    for (auto& sink : sinks) {
+        sink->write(record);
+    }
+}
+
+size_t Backend::drain(const std::vector<std::shared_ptr<LogSink>>& sinks) {
+    size_t count = 0;
+    for (auto& ring : _drain_rings) {
+        bool closed = ring->closed.load(std::memory_order_acquire);
+        count += ring->consume([&](const RecordHeader& header, const char* data) {
+            LogRecord record;
+            record.level      = header.level;
+            record.categories = header.categories;
+            record.filename   = header.filename;
+            record.line_no    = header.line_no;
+            record.thread_id  = ring->thread_id();
+            record.timestamp  = std::chrono::system_clock::time_point(
+                std::chrono::duration_cast<std::chrono::system_clock::duration>(
+                    std::chrono::nanoseconds(header.timestamp_nsec)));
+
+            if (header.type == RecordType::HEX) {
+                _format_buf.assign(data, header.title_len);
+                _format_buf.append(fmt::format(" ({} bytes): ", header.payload_len));
+                append_hex(_format_buf, data + header.title_len, header.payload_len);
+                record.message = _format_buf;
+            } else if (header.type == RecordType::DEFERRED) {
+                DeferredPrefix prefix;
+                std::memcpy(&prefix, data, sizeof(prefix));
+                _format_buf.clear();
+                try {
+                    prefix.formatter(_format_buf, std::string_view(prefix.format, prefix.format_len),
+                                     reinterpret_cast<const std::byte*>(data + sizeof(prefix)));
+                } catch (const std::exception& e) {
+                    _format_buf = fmt::format("Formatting \"{}\" failed: {}",
+                                           std::string_view(prefix.format, prefix.format_len), e.what());
+                }
+                record.message = _format_buf;
+            } else {
+                record.message = std::string_view(data, header.payload_len);
+            }
+            write(sinks, record);
+        });
+
+        if (overflow_policy == OverflowPolicy::COUNT) {
+            uint64_t dropped = ring->dropped.load(std::memory_order_relaxed);
+            if (dropped != ring->reported_dropped) {
+                auto msg = fmt::format("{} log records dropped, ring buffer full",
+                                       dropped - ring->reported_dropped);
+                LogRecord record{LogLevel::WARN, 0,   __FILE__, __LINE__, ring->thread_id(),
+                                 std::chrono::system_clock::now(), msg};
+                write(sinks, record);
+                ring->reported_dropped = dropped;
+            }
+        }
+        ring->retired = closed;
+    }
+    return count;
+}
+
+void Backend::run() {
+    std::vector<std::shared_ptr<LogSink>> sinks;
+    uint64_t config_version = UINT64_MAX;
+    std::chrono::microseconds poll_interval;
+
+    while (true) {
+        uint64_t flush_requested;
+        bool stopping;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            flush_requested = _flush_requested;
+            stopping        = _stopping;
+            poll_interval   = _config.backend_poll_interval;
+
+            // Forget rings whose thread exited before the last drain pass emptied them
+            auto closed = std::remove_if(_rings.begin(), _rings.end(), [&](const auto& ring) {
+                if (ring->retired) {
+                    _retired_dropped += ring->dropped.load(std::memory_order_relaxed);
+                    return true;
+                }
+                return false;
+            });
+            if (closed != _rings.end()) {
+                _rings.erase(closed, _rings.end());
+                _config_version++;
+            }
+
+            if (config_version != _config_version) {
+                config_version = _config_version;
+                _drain_rings   = _rings;
+                sinks          = _sinks;
+            }
+        }
+
+        size_t count = drain(sinks);
+
+        if (flush_requested > _flush_done || stopping) {
+            for (auto& sink : sinks) {
+                sink->flush();
+            }
+            std::lock_guard<std::mutex> lock(_mutex);
+            _flush_done = flush_requested;
+            _cv.notify_all();
+        }
+
+        if (stopping) {
+            break;
+        }
+
+        if (count == 0) {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _cv.wait_for(lock, poll_interval, [&] { return _flush_requested > _flush_done || _stopping; });
+        }
+    }
+}
+
+// Drains and stops the backend before static destruction tears down the sinks
+struct ShutdownAtExit {
+    ~ShutdownAtExit() { Backend::instance().shutdown(); }
+} shutdown_at_exit;
+
+ProducerRing* producer_ring() {
+    if (t_ring.ring) {
+        return t_ring.ring.get();
+    }
+    return Backend::instance().register_thread();
+}
+
+RecordHeader make_header(RecordType type, LogLevel level, CategoryType categories, const char* filename,
+                         unsigned int line_no) {
+    RecordHeader header   = {};
+    header.type           = type;
+    header.level          = level;
+    header.line_no        = line_no;
+    header.categories     = categories;
+    header.filename       = filename;
+    header.timestamp_nsec = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                std::chrono::system_clock::now().time_since_epoch())
+                                .count();
+    return header;
+}
+
+void count_dropped(ProducerRing* ring) {
+    ring->dropped.store(ring->dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+// Returns nullptr, after counting the record as dropped, if the overflow policy doesn't allow to wait
+std::byte* reserve(ProducerRing* ring, size_t size) {
+    auto& backend = Backend::instance();
+    std::byte* p;
+    while (!(p = ring->try_reserve(size))) {
+        if (backend.overflow_policy.load(std::memory_order_relaxed) != OverflowPolicy::BLOCK ||
+            !backend.active.load(std::memory_order_relaxed)) {
+            count_dropped(ring);
+            return nullptr;
+        }
+        std::this_thread::yield();
+    }
+    return p;
+}
+
+void push(RecordType type, LogLevel level, CategoryType categories, const char* filename, unsigned int line_no,
+          std::string_view title, std::string_view payload) {
+    if (!Backend::instance().active.load(std::memory_order_relaxed)) {
+        return;
+    }
+
+    auto* ring         = producer_ring();
+    RecordHeader header = make_header(type, level, categories, filename, line_no);
+    // Truncate title first, then payload, so the aligned record stays within max_record_size()
+    size_t room         = ring->max_record_size() - sizeof(RecordHeader);
+    title               = title.substr(0, std::min<size_t>({title.size(), room, UINT16_MAX}));
+    payload             = payload.substr(0, std::min(payload.size(), room - title.size()));
+    header.title_len    = static_cast<uint16_t>(title.size());
+    header.payload_len  = static_cast<uint32_t>(payload.size());
+    header.size         = static_cast<uint32_t>(align_up(sizeof(RecordHeader) + title.size() + payload.size()));
+
+    std::byte* p = reserve(ring, header.size);
+    if (!p) {
+        return;
+    }
+    std::memcpy(p, &header, sizeof(header));
+    std::memcpy(p + sizeof(header), title.data(), title.size());
+    std::memcpy(p + sizeof(header) + title.size(), payload.data(), payload.size());
+    ring->commit();
+}
+
+}
+
+void asio::logger::configure(const LoggerConfig& config) {
+    Backend::instance().configure(config);
+}
+
+void asio::logger::set_level(LogLevel level) {
+    Backend::instance().set_level(level);
+}
+
+LogLevel asio::logger::get_level() {
+    return Backend::instance().get_level();
+}
+
+CategoryType asio::logger::register_category(const char* name) {
+    return Backend::instance().register_category(name);
+}
+
+void asio::logger::set_category_level(CategoryType category, LogLevel level) {
+    Backend::instance().set_category_level(category, level);
+}
+
+void asio::logger::set_category_level(std::string_view name, LogLevel level) {
+    Backend::instance().set_category_level(name, level);
+}
+
+std::optional<LogLevel> asio::logger::get_category_level(std::string_view name) {
+    return Backend::instance().get_category_level(name);
+}
+
+int asio::logger::set_category_levels(std::string_view spec) {
+    return Backend::instance().set_category_levels(spec);
+}
+
+void asio::logger::add_sink(std::shared_ptr<LogSink> sink) {
+    Backend::instance().add_sink(std::move(sink));
+}
+
+void asio::logger::remove_sinks() {
+    Backend::instance().remove_sinks();
+}
+
+void asio::logger::flush() {
+    Backend::instance().flush();
+}
+
+void asio::logger::shutdown() {
+    Backend::instance().shutdown();
+}
+
+std::byte* asio::logger::detail::begin_deferred(LogLevel level, CategoryType categories, const char* filename,
+                                                unsigned int line_no, std::string_view format,
+                                                DeferredFormatter formatter, size_t args_size) {
+    if (!Backend::instance().active.load(std::memory_order_relaxed)) {
+        return nullptr;
+    }
+
+    auto* ring          = producer_ring();
+    RecordHeader header = make_header(RecordType::DEFERRED, level, categories, filename, line_no);
+    header.payload_len  = static_cast<uint32_t>(sizeof(DeferredPrefix) + args_size);
+    header.size         = static_cast<uint32_t>(align_up(sizeof(RecordHeader) + header.payload_len));
+    if (header.size > ring->max_record_size()) {
+        // Encoded arguments can't be truncated
+        count_dropped(ring);
+        return nullptr;
+    }
+
+    std::byte* p = reserve(ring, header.size);
+    if (!p) {
+        return nullptr;
+    }
+    DeferredPrefix prefix = {formatter, format.data(), format.size()};
+    std::memcpy(p, &header, sizeof(header));
+    std::memcpy(p + sizeof(header), &prefix, sizeof(prefix));
+    return p + sizeof(header) + sizeof(prefix);
+}
+
+void asio::logger::detail::commit_deferred() {
+    t_ring.ring->commit();
+}
+
+uint64_t asio::logger::dropped_records() {
+    return Backend::instance().dropped_records();
+}
 
 void asio::logger::log(LogLevel level, CategoryType categories, const char* filename, unsigned int line_no,
                        const std::string& msg) {
+    push(RecordType::MESSAGE, level, categories, filename, line_no, {}, msg);
 }
 
 
 void asio::logger::logHex(LogLevel level, CategoryType categories, const char* filename, unsigned int line_no,
                           const std::string& title, const void* data, size_t len) {
+    push(RecordType::HEX, level, categories, filename, line_no, title,
+         std::string_view(static_cast<const char*>(data), data ? len : 0));
 }
@@ -1,14 +1,21 @@
 #include "mqtt_client.hpp"
+#include "handler_allocator.hpp"
 #include "logger.hpp"
 
 #include "string_util.hpp"
 #include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/redirect_error.hpp>
+#include <boost/asio/use_awaitable.hpp>
 #include <cstdlib>
 #include <iostream>
 #include <map>
 #include <mosquitto.h>
+#include <mutex>
+#include <optional>
 #include <string>
 
+DEFINE_LOG_CATEGORY(L_MQTT, "MQTT");
+
 namespace asio::utils {
 
 
@@ -24,6 +31,9 @@ public:
 
     int publish_data(const char* topic, const void* buf, const int len, MqttQos qos, bool retain = false) override;
 
+    boost::asio::awaitable<int> async_publish(const char* topic, const void* buf, const int len, MqttQos qos,
+                                              bool retain = false) override;
+
     int subscribe_topic(const char* topic) override;
 
     int unsubscribe_topic(const char* topic) override;
@@ -36,6 +46,8 @@ public:
 
     void unregister_topic_callback(const std::string& topic) override;
 
+    void set_priority(HandlerPriority priority) override;
+
 private:
     friend void on_connect(struct mosquitto* mosq, void* obj, int reason_code);
     friend void on_message(struct mosquitto* mosq, void* obj, const struct mosquitto_message* msg);
@@ -62,6 +74,15 @@ private:
     void start_loop_misc_timer();
     void loop_misc_timer_handler();
 
+    // Timer::stop() doesn't wait for a callback already running on another thread, so the timer
+    // callbacks hold the guard and skip the handler once the destructor cleared alive
+    struct CallbackGuard {
+        std::mutex mutex;
+        bool alive = true;
+    };
+    template <typename Handler>
+    std::function<void()> guarded(Handler handler);
+
     boost::asio::io_context& _io_ctx;
     std::string _mqtt_broker_addr;
 
@@ -70,6 +91,8 @@ private:
     const char* _client_id;
 
     boost::asio::posix::stream_descriptor _mqtt_socket;
+    PriorityScheduler::executor_type _executor;
+    std::optional<HandlerPriority> _priority;
     int _dev_mqtt_fd;
     struct mosquitto* _mosq;
     std::shared_ptr<asio::utils::Timer> _connection_status_timer;
@@ -78,6 +101,7 @@ private:
     std::function<void(const char* topic, const void* payload, int len)> _mqtt_data_received_cb;
     std::atomic_bool _connection_status = true;
     std::atomic_bool _reconnect_required = true;
+    std::shared_ptr<CallbackGuard> _callback_guard = std::make_shared<CallbackGuard>();
     std::map<std::string, std::function<void(const char* topic, const void* payload, int len)>>
         _mqtt_topic_data_received_cb;
 };
@@ -90,6 +114,7 @@ MqttClientImpl::MqttClientImpl(boost::asio::io_context& io, std::string broker_a
       _clean_session(clean_session),
       _client_id(client_id),
       _mqtt_socket(io),
+      _executor(io),
       _dev_mqtt_fd(-1) {
     mosquitto_lib_init();
 
@@ -125,12 +150,19 @@ MqttClientImpl::MqttClientImpl(boost::asio::io_context& io, std::string broker_a
 
     start_loop_misc_timer();
 
-    LOG_INFO(L_ASIOUTIL, "Mosquitto Client : {} started and configured to V31 protocol", client_id);
+    LOG_INFO(L_MQTT, "Mosquitto Client : {} started and configured to V31 protocol", client_id);
 }
 
 MqttClientImpl::~MqttClientImpl() {
     _reconnect_required = false;
+    {
+        std::lock_guard lock(_callback_guard->mutex);
+        _callback_guard->alive = false;
+    }
     _mosquitto_loop_misc_timer->stop();
+    if (_connection_status_timer) {
+        _connection_status_timer->stop();
+    }
     mosquitto_disconnect(_mosq);
     mosquitto_destroy(_mosq);
     mosquitto_lib_cleanup();
@@ -138,14 +170,14 @@ MqttClientImpl::~MqttClientImpl() {
 
 int MqttClientImpl::publish_data(const char* topic, const void* buf, const int len, MqttQos qos, bool retain) {
     if (!topic || !buf || !len || qos < MqttQosMin || qos > MqttQosMax) {
-        LOG_ERROR(L_ASIOUTIL, " [{}] Cannot publish the data, invalid parameters provided of length {} and Qos {}",
+        LOG_ERROR(L_MQTT, " [{}] Cannot publish the data, invalid parameters provided of length {} and Qos {}",
                   __func__, len, (int)qos);
         return -1;
     }
 
     int rc = mosquitto_publish(_mosq, nullptr, topic, len, buf, qos, retain);
     if (rc != MOSQ_ERR_SUCCESS) {
-        LOG_ERROR(L_ASIOUTIL, " [{}] Error in publishing {}", __func__, mosquitto_strerror(rc));
+        LOG_ERROR(L_MQTT, " [{}] Error in publishing {}", __func__, mosquitto_strerror(rc));
         return -1;
     }
 
@@ -153,9 +185,40 @@ int MqttClientImpl::publish_data(const char* topic, const void* buf, const int l
     return 0;
 }
 
+boost::asio::awaitable<int> MqttClientImpl::async_publish(const char* topic, const void* buf, const int len,
+                                                          MqttQos qos, bool retain) {
+    if (!topic || !buf || !len || qos < MqttQosMin || qos > MqttQosMax) {
+        LOG_ERROR(L_MQTT, " [{}] Cannot publish the data, invalid parameters provided of length {} and Qos {}",
+                  __func__, len, (int)qos);
+        co_return -1;
+    }
+
+    // mosquitto copies the payload, so topic and buf are not used past this point
+    int rc = mosquitto_publish(_mosq, nullptr, topic, len, buf, qos, retain);
+    if (rc != MOSQ_ERR_SUCCESS) {
+        LOG_ERROR(L_MQTT, " [{}] Error in publishing {}", __func__, mosquitto_strerror(rc));
+        co_return -1;
+    }
+
+    boost::system::error_code ec;
+    co_await _mqtt_socket.async_wait(boost::asio::posix::stream_descriptor::wait_write,
+                                     boost::asio::redirect_error(boost::asio::use_awaitable, ec));
+    if (ec) {
+        LOG_ERROR(L_MQTT, "[{}] error {}: {}", __func__, ec.value(), ec.message());
+        co_return -1;
+    }
+
+    rc = mosquitto_loop_write(_mosq, 1);
+    if (rc != MOSQ_ERR_SUCCESS) {
+        LOG_WARN(L_MQTT, "In [{}]Loop write failed with error code: {}", __func__, rc);
+        co_return -1;
+    }
+    co_return 0;
+}
+
 int MqttClientImpl::subscribe_topic(const char* topic) {
     if (!topic) {
-        LOG_ERROR(L_ASIOUTIL, "Invalid topic {}", topic);
+        LOG_ERROR(L_MQTT, "Invalid topic {}", topic);
         return -1;
     }
 
@@ -163,7 +226,7 @@ int MqttClientImpl::subscribe_topic(const char* topic) {
     
     rc = mosquitto_subscribe(_mosq, nullptr, topic, 1);
     if (rc != MOSQ_ERR_SUCCESS) {
-        LOG_ERROR(L_ASIOUTIL, " [{}] Error in subscribing to topic {}", topic, mosquitto_strerror(rc));
+        LOG_ERROR(L_MQTT, " [{}] Error in subscribing to topic {}", topic, mosquitto_strerror(rc));
         return -1;
     }
 
@@ -177,13 +240,13 @@ int MqttClientImpl::subscribe_topic(const char* topic) {
 
 int MqttClientImpl::unsubscribe_topic(const char* topic) {
     if (!topic) {
-        LOG_ERROR(L_ASIOUTIL, "Invalid topic {}", topic);
+        LOG_ERROR(L_MQTT, "Invalid topic {}", topic);
         return -1;
     }
 
     int rc = mosquitto_unsubscribe(_mosq, nullptr, topic);
     if (rc != MOSQ_ERR_SUCCESS) {
-        LOG_ERROR(L_ASIOUTIL, " [{}] Error in subscribing to topic {}", topic, mosquitto_strerror(rc));
+        LOG_ERROR(L_MQTT, " [{}] Error in subscribing to topic {}", topic, mosquitto_strerror(rc));
         return -1;
     }
 
@@ -201,17 +264,17 @@ int MqttClientImpl::unsubscribe_topic(const char* topic) {
 int MqttClientImpl::register_callback(
     std::function<void(const char* topic, const void* payload, int len)> callback_fn) {
     if (!callback_fn) {
-        LOG_ERROR(L_ASIOUTIL, " [{}] Cannot register as callback function is nullptr", __func__);
+        LOG_ERROR(L_MQTT, " [{}] Cannot register as callback function is nullptr", __func__);
         return EINVAL;
     }
 
     if (_mqtt_data_received_cb != nullptr) {
-        LOG_ERROR(L_ASIOUTIL, " [{}] callback is already registered", __func__);
+        LOG_ERROR(L_MQTT, " [{}] callback is already registered", __func__);
         return EALREADY;
     }
 
     _mqtt_data_received_cb = callback_fn;
-    LOG_INFO(L_ASIOUTIL, "MqttRx Callback set");
+    LOG_INFO(L_MQTT, "MqttRx Callback set");
 
     return 0;
 }
@@ -224,12 +287,12 @@ int MqttClientImpl::register_topic_callback(
     const std::string& topic, std::function<void(const char* topic, const void* payload, int len)> callback_fn) {
 
     if (!callback_fn) {
-        LOG_ERROR(L_ASIOUTIL, " [{}] Cannot register as topic callback function is nullptr", __func__);
+        LOG_ERROR(L_MQTT, " [{}] Cannot register as topic callback function is nullptr", __func__);
         return EINVAL;
     }
 
     if (_mqtt_topic_data_received_cb.find(topic) != std::end(_mqtt_topic_data_received_cb)) {
-        LOG_ERROR(L_ASIOUTIL, " [{}] callback for topic {} is already registered", __func__, topic);
+        LOG_ERROR(L_MQTT, " [{}] callback for topic {} is already registered", __func__, topic);
         return EALREADY;
     }
 
@@ -242,19 +305,28 @@ void MqttClientImpl::unregister_topic_callback(const std::string& topic) {
     _mqtt_topic_data_received_cb.erase(topic);
 }
 
+void MqttClientImpl::set_priority(HandlerPriority priority) {
+    _priority = priority;
+    _executor = PriorityScheduler::executor(_io_ctx, priority);
+    _mosquitto_loop_misc_timer->set_priority(priority);
+    if (_connection_status_timer) {
+        _connection_status_timer->set_priority(priority);
+    }
+}
+
 int MqttClientImpl::setup_mqtt_communicator() {
     
     _dev_mqtt_fd = mosquitto_socket(_mosq);
 
     if (-1 == _dev_mqtt_fd) {
-        LOG_ERROR(L_ASIOUTIL, "Invalid Mosquitto Socket: {} ", _dev_mqtt_fd);
+        LOG_ERROR(L_MQTT, "Invalid Mosquitto Socket: {} ", _dev_mqtt_fd);
         return -1;
     }
 
     _mqtt_socket.assign(_dev_mqtt_fd);
     _mqtt_socket.non_blocking(true);
     
-    LOG_INFO(L_ASIOUTIL, "[{}]Schedule async read for Mosquitto Socket number: {} ", __func__, _dev_mqtt_fd);
+    LOG_INFO(L_MQTT, "[{}]Schedule async read for Mosquitto Socket number: {} ", __func__, _dev_mqtt_fd);
 
     schedule_mqtt_rx();
 
@@ -262,76 +334,90 @@ int MqttClientImpl::setup_mqtt_communicator() {
 }
 
 void MqttClientImpl::schedule_mqtt_rx() {
-    _mqtt_socket.async_read_some(boost::asio::null_buffers(),
-                                 std::bind(&MqttClientImpl::on_mqtt_rx, this, std::placeholders::_1));
+    _mqtt_socket.async_read_some(
+        boost::asio::null_buffers(),
+        boost::asio::bind_executor(_executor, with_recycling_allocator([this](auto error, std::size_t) { on_mqtt_rx(error); })));
 }
 
 void MqttClientImpl::on_mqtt_rx(const std::error_code& error_code) {
-    LOG_TRACE(L_ASIOUTIL, "In [{}] ", __func__);
+    LOG_TRACE(L_MQTT, "In [{}] ", __func__);
     if (_connection_status) {
     
         if (error_code) {
-            LOG_ERROR(L_ASIOUTIL, "[{}] error {}: {}", __func__, error_code.value(), error_code.message());
+            LOG_ERROR(L_MQTT, "[{}] error {}: {}", __func__, error_code.value(), error_code.message());
         } else {
             auto ev = mosquitto_loop_read(_mosq, 1);
             if (MOSQ_ERR_SUCCESS == ev) {
-                LOG_DEBUG(L_ASIOUTIL, "Moquitto Loop read Success .. ");
+                LOG_DEBUG(L_MQTT, "Moquitto Loop read Success .. ");
             } else {
-                LOG_WARN(L_ASIOUTIL, "In [{}]Loop read failed with error code: {}", __func__, ev);
+                LOG_WARN(L_MQTT, "In [{}]Loop read failed with error code: {}", __func__, ev);
             }
         }
     
         schedule_mqtt_rx();
     } else {
-        LOG_ERROR(L_ASIOUTIL, "In {}..mosquitto not connected", __func__);
+        LOG_ERROR(L_MQTT, "In {}..mosquitto not connected", __func__);
     }
 }
 
 void MqttClientImpl::schedule_mqtt_tx() {
-    _mqtt_socket.async_write_some(boost::asio::null_buffers(),
-                                  std::bind(&MqttClientImpl::on_mqtt_tx, this, std::placeholders::_1));
+    _mqtt_socket.async_write_some(
+        boost::asio::null_buffers(),
+        boost::asio::bind_executor(_executor, with_recycling_allocator([this](auto error, std::size_t) { on_mqtt_tx(error); })));
 }
 
 void MqttClientImpl::on_mqtt_tx(const std::error_code& error_code) {
-    LOG_DEBUG(L_ASIOUTIL, "In [{}] ", __func__);
+    LOG_DEBUG(L_MQTT, "In [{}] ", __func__);
     if (_connection_status) {
     
         if (error_code) {
-            LOG_ERROR(L_ASIOUTIL, "[{}] error {}: {}", __func__, error_code.value(), error_code.message());
+            LOG_ERROR(L_MQTT, "[{}] error {}: {}", __func__, error_code.value(), error_code.message());
         } else {
             auto ev = mosquitto_loop_write(_mosq, 1);
             if (MOSQ_ERR_SUCCESS == ev) {
-                LOG_DEBUG(L_ASIOUTIL, "Moquitto Loop write Success ..");
+                LOG_DEBUG(L_MQTT, "Moquitto Loop write Success ..");
             } else {
-                LOG_WARN(L_ASIOUTIL, "In [{}]Loop write failed with error code: {}", __func__, ev);
+                LOG_WARN(L_MQTT, "In [{}]Loop write failed with error code: {}", __func__, ev);
             }
         }
     } else {
-        LOG_ERROR(L_ASIOUTIL, "In {}..mosquitto not connected", __func__);
+        LOG_ERROR(L_MQTT, "In {}..mosquitto not connected", __func__);
     }
 }
 
+template <typename Handler>
+std::function<void()> MqttClientImpl::guarded(Handler handler) {
+    return [this, guard = _callback_guard, handler]() {
+        std::lock_guard lock(guard->mutex);
+        if (guard->alive) {
+            (this->*handler)();
+        }
+    };
+}
+
 void MqttClientImpl::start_connection_timer() {
     TimerConfig timer_config;
     timer_config.name = std::string("connection_timer");
     timer_config.start_interval_msec = std::chrono::milliseconds(CONNECTION_POLL_INTERVAL);
     timer_config.periodic_interval_msec = std::chrono::milliseconds(CONNECTION_POLL_INTERVAL);
-    timer_config.callback_fn = [&]() { connection_timer_handler(); };
+    timer_config.slack       = std::chrono::milliseconds(CONNECTION_POLL_INTERVAL / 10);
+    timer_config.callback_fn = guarded(&MqttClientImpl::connection_timer_handler);
+    timer_config.priority    = _priority;
     _connection_status_timer = Timer::create(timer_config, _io_ctx);
     _connection_status_timer->start();
 }
 
 void MqttClientImpl::connection_timer_handler() {
-    LOG_TRACE(L_ASIOUTIL, "In [{}] ", __func__);
+    LOG_TRACE(L_MQTT, "In [{}] ", __func__);
     if (!_connection_status) {
         if (MOSQ_ERR_SUCCESS != mosquitto_connect(_mosq, _mqtt_broker_addr.c_str(), _mqtt_port, 60)) {
-            LOG_ERROR(L_ASIOUTIL, "Cannot connect to mosquitto broker..try again");
+            LOG_ERROR(L_MQTT, "Cannot connect to mosquitto broker..try again");
         } else {
             int rc = MOSQ_ERR_UNKNOWN;
             for (auto& topic : _subscribed_topics) {
                 rc = mosquitto_subscribe(_mosq, nullptr, topic.c_str(), 1);
                 if (rc != MOSQ_ERR_SUCCESS) {
-                    LOG_ERROR(L_ASIOUTIL, " [{}] Error in subscribing to topic {}", topic, mosquitto_strerror(rc));
+                    LOG_ERROR(L_MQTT, " [{}] Error in subscribing to topic {}", topic, mosquitto_strerror(rc));
                 }
             }
             if (rc == MOSQ_ERR_SUCCESS) {
@@ -341,7 +427,7 @@ void MqttClientImpl::connection_timer_handler() {
             }
         }
     } else {
-        LOG_INFO(L_ASIOUTIL, "Connected to mosquitto broker");
+        LOG_INFO(L_MQTT, "Connected to mosquitto broker");
         _connection_status_timer->stop();
     }
 }
@@ -352,17 +438,19 @@ void MqttClientImpl::start_loop_misc_timer() {
     timer_config.start_interval_msec = std::chrono::milliseconds(MOSQUITTO_LOOP_MISC_POLL_INTERVAL);
     timer_config.periodic_interval_msec = std::chrono::milliseconds(
         MOSQUITTO_LOOP_MISC_POLL_INTERVAL);
-    timer_config.callback_fn = [&]() { loop_misc_timer_handler(); };
+    timer_config.slack       = std::chrono::milliseconds(MOSQUITTO_LOOP_MISC_POLL_INTERVAL / 10);
+    timer_config.callback_fn = guarded(&MqttClientImpl::loop_misc_timer_handler);
+    timer_config.priority    = _priority;
     _mosquitto_loop_misc_timer = Timer::create(timer_config, _io_ctx);
     _mosquitto_loop_misc_timer->start();
 }
 
 void MqttClientImpl::loop_misc_timer_handler() {
-    LOG_TRACE(L_ASIOUTIL, "In [{}] ", __func__);
+    LOG_TRACE(L_MQTT, "In [{}] ", __func__);
     if (MOSQ_ERR_SUCCESS == mosquitto_loop_misc(_mosq)) {
-        LOG_DEBUG(L_ASIOUTIL, "In [{}] mosquitto_loop_misc SUCCESS", __func__);
+        LOG_DEBUG(L_MQTT, "In [{}] mosquitto_loop_misc SUCCESS", __func__);
     } else {
-        LOG_WARN(L_ASIOUTIL, "In [{}] mosquitto_loop_misc FAILS... looks like mosquitto broker is not running",
+        LOG_WARN(L_MQTT, "In [{}] mosquitto_loop_misc FAILS... looks like mosquitto broker is not running",
                  __func__);
     }
 }
@@ -373,7 +461,7 @@ void on_connect(struct mosquitto* mosq, void* obj, int reason_code) {
         mosquitto_disconnect(mosq);
         return;
     }
-    LOG_DEBUG(L_ASIOUTIL, "on connect code {}", reason_code);
+    LOG_DEBUG(L_MQTT, "on connect code {}", reason_code);
     self->_connection_status = true;
 }
 
@@ -407,7 +495,7 @@ on_subscribe(struct mosquitto* mosq, void* obj, int mid, int qos_count, const in
 
 void on_unsubscribe(struct mosquitto* mosq, void* obj, int mid) {
     auto* self = (asio::utils::MqttClientImpl*)obj;
-    LOG_DEBUG(L_ASIOUTIL, "on_unsubscribe");
+    LOG_DEBUG(L_MQTT, "on_unsubscribe");
 }
 
 static void
@@ -427,7 +515,7 @@ void MqttClientImpl::set_callbacks() {
 }
 
 void MqttClientImpl::on_disconnection_msg(struct mosquitto* mosq, void* data, int rc) {
-    LOG_INFO(L_ASIOUTIL, "In [{}] ", __func__);
+    LOG_INFO(L_MQTT, "In [{}] ", __func__);
     if (!_connection_status) {
         _mqtt_socket.release();
 
@@ -0,0 +1,86 @@
+#include "priority_scheduler.hpp"
+#include "logger.hpp"
+
+using namespace asio::utils;
+
+boost::asio::execution_context::id PriorityScheduler::id;
+
+PriorityScheduler::PriorityScheduler(boost::asio::io_context& io_ctx)
+    : boost::asio::execution_context::service(io_ctx), _io_ctx(io_ctx) {}
+
+PriorityScheduler::executor_type PriorityScheduler::get_executor(HandlerPriority priority)
+{
+    return executor_type(*this, priority);
+}
+
+PriorityScheduler::executor_type PriorityScheduler::executor(boost::asio::io_context& io_ctx,
+                                                             HandlerPriority priority)
+{
+    return boost::asio::use_service<PriorityScheduler>(io_ctx).get_executor(priority);
+}
+
+void PriorityScheduler::shutdown()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (auto& level : _levels) {
+        level.queue.clear();
+    }
+}
+
+void PriorityScheduler::run_one()
+{
+    QueuedHandlerPtr handler;
+    Level* level = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        for (auto& l : _levels) {
+            if (!l.queue.empty()) {
+                handler = std::move(l.queue.front());
+                l.queue.pop_front();
+                level = &l;
+                break;
+            }
+        }
+    }
+
+    if (!handler) {
+        LOG_WARN(L_ASIOUTIL, "[{}] Token without a queued handler", __func__);
+        return;
+    }
+
+    uint64_t wait_nsec = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                             std::chrono::steady_clock::now() - handler->enqueued)
+                             .count();
+    level->dispatched.fetch_add(1, std::memory_order_relaxed);
+    level->total_wait_nsec.fetch_add(wait_nsec, std::memory_order_relaxed);
+    uint64_t max_wait = level->max_wait_nsec.load(std::memory_order_relaxed);
+    while (wait_nsec > max_wait &&
+           !level->max_wait_nsec.compare_exchange_weak(max_wait, wait_nsec, std::memory_order_relaxed)) {
+    }
+
+    handler->invoke();
+}
+
+PriorityQueueStats PriorityScheduler::stats(HandlerPriority priority) const
+{
+    const auto& level = _levels[static_cast<size_t>(priority)];
+
+    PriorityQueueStats stats;
+    stats.dispatched = level.dispatched.load(std::memory_order_relaxed);
+    stats.total_wait = std::chrono::nanoseconds(level.total_wait_nsec.load(std::memory_order_relaxed));
+    stats.max_wait   = std::chrono::nanoseconds(level.max_wait_nsec.load(std::memory_order_relaxed));
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        stats.pending = level.queue.size();
+    }
+    return stats;
+}
+
+void PriorityScheduler::reset_stats()
+{
+    for (auto& level : _levels) {
+        level.dispatched      = 0;
+        level.total_wait_nsec = 0;
+        level.max_wait_nsec   = 0;
+    }
+}
@@ -0,0 +1,83 @@
+#include "rx_timestamp.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cerrno>
+#include <linux/errqueue.h>
+#include <linux/net_tstamp.h>
+
+using namespace asio::utils;
+
+static std::chrono::nanoseconds to_nanoseconds(const timespec& ts) {
+    return std::chrono::seconds(ts.tv_sec) + std::chrono::nanoseconds(ts.tv_nsec);
+}
+
+int asio::utils::enable_rx_timestamps(int fd, bool hardware) {
+    int ret;
+    if (hardware) {
+        int flags = SOF_TIMESTAMPING_RX_HARDWARE | SOF_TIMESTAMPING_RAW_HARDWARE | SOF_TIMESTAMPING_RX_SOFTWARE |
+                    SOF_TIMESTAMPING_SOFTWARE;
+        ret = setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags));
+    } else {
+        int on = 1;
+        ret    = setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on));
+    }
+    return ret < 0 ? errno : 0;
+}
+
+RxTimestamp asio::utils::parse_rx_timestamp(const msghdr& msg) {
+    RxTimestamp timestamp;
+    for (auto* cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(const_cast<msghdr*>(&msg), cmsg)) {
+        if (cmsg->cmsg_level != SOL_SOCKET) {
+            continue;
+        }
+        if (cmsg->cmsg_type == SCM_TIMESTAMPNS) {
+            timestamp.software = to_nanoseconds(*reinterpret_cast<const timespec*>(CMSG_DATA(cmsg)));
+        } else if (cmsg->cmsg_type == SCM_TIMESTAMPING) {
+            // ts[0] is the software stamp, ts[2] the raw hardware one
+            auto* ts           = reinterpret_cast<const scm_timestamping*>(CMSG_DATA(cmsg))->ts;
+            timestamp.software = to_nanoseconds(ts[0]);
+            timestamp.hardware = to_nanoseconds(ts[2]);
+        }
+    }
+    return timestamp;
+}
+
+void RxLatencyRecorder::record(const RxTimestamp& timestamp) {
+    if (!timestamp.software.count()) {
+        return;
+    }
+    // Kernel stamps are CLOCK_REALTIME
+    timespec now = {};
+    clock_gettime(CLOCK_REALTIME, &now);
+    auto latency  = std::max(to_nanoseconds(now) - timestamp.software, std::chrono::nanoseconds(0));
+    auto usec     = std::chrono::duration_cast<std::chrono::microseconds>(latency).count();
+    size_t bucket = std::min<size_t>(std::bit_width(static_cast<uint64_t>(usec)), RxLatencyStats::LATENCY_BUCKETS - 1);
+
+    _count.fetch_add(1, std::memory_order_relaxed);
+    _latency_histogram[bucket].fetch_add(1, std::memory_order_relaxed);
+    _total_latency_ns.fetch_add(latency.count(), std::memory_order_relaxed);
+    if (latency.count() > _max_latency_ns.load(std::memory_order_relaxed)) {
+        _max_latency_ns.store(latency.count(), std::memory_order_relaxed);
+    }
+}
+
+RxLatencyStats RxLatencyRecorder::stats() const {
+    RxLatencyStats stats;
+    stats.count         = _count.load(std::memory_order_relaxed);
+    stats.total_latency = std::chrono::nanoseconds(_total_latency_ns.load(std::memory_order_relaxed));
+    stats.max_latency   = std::chrono::nanoseconds(_max_latency_ns.load(std::memory_order_relaxed));
+    for (size_t i = 0; i < RxLatencyStats::LATENCY_BUCKETS; i++) {
+        stats.latency_histogram[i] = _latency_histogram[i].load(std::memory_order_relaxed);
+    }
+    return stats;
+}
+
+void RxLatencyRecorder::reset() {
+    _count.store(0, std::memory_order_relaxed);
+    _total_latency_ns.store(0, std::memory_order_relaxed);
+    _max_latency_ns.store(0, std::memory_order_relaxed);
+    for (auto& bucket : _latency_histogram) {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+}
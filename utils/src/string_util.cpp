@@ -1,10 +1,16 @@
 #include "string_util.hpp"
 
 #include <algorithm>
+#include <array>
 #include <charconv>
 #include <cstring>
 #include <sstream>
 
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define ASIO_UTILS_HEX_X86
+#endif
+
 using namespace asio::utils;
 
 namespace asio::utils::stringUtil {
@@ -96,4 +102,149 @@ std::optional<std::pair<std::string, uint32_t>> split_url_into_address_and_port(
     }
 }
 
+namespace {
+
+using detail::HexKernel;
+
+constexpr auto HEX_PAIRS = [] {
+    constexpr char digits[] = "0123456789abcdef";
+    std::array<std::array<char, 2>, 256> pairs{};
+    for (size_t i = 0; i < pairs.size(); i++) {
+        pairs[i] = {digits[i >> 4], digits[i & 0x0f]};
+    }
+    return pairs;
+}();
+
+char* hex_dump_scalar(char* out, const uint8_t* data, size_t len)
+{
+    for (size_t i = 0; i < len; i++) {
+        std::memcpy(out, HEX_PAIRS[data[i]].data(), 2);
+        out[2] = ' ';
+        out += 3;
+    }
+    return out;
+}
+
+#ifdef ASIO_UTILS_HEX_X86
+
+// pshufb masks that spread the 32 hex digits of 16 bytes, held in two registers, over
+// 48 output bytes with a space after every pair. -1 selects zero, later or'ed with the space
+struct SpreadMasks {
+    alignas(16) int8_t from_first[3][16];
+    alignas(16) int8_t from_second[3][16];
+    alignas(16) int8_t spaces[3][16];
+};
+
+constexpr SpreadMasks SPREAD = [] {
+    SpreadMasks masks{};
+    for (int chunk = 0; chunk < 3; chunk++) {
+        for (int k = 0; k < 16; k++) {
+            int pos       = chunk * 16 + k;
+            int digit     = pos / 3 * 2 + pos % 3;
+            bool is_space = pos % 3 == 2;
+
+            masks.from_first[chunk][k]  = !is_space && digit < 16 ? digit : -1;
+            masks.from_second[chunk][k] = !is_space && digit >= 16 ? digit - 16 : -1;
+            masks.spaces[chunk][k]      = is_space ? ' ' : 0;
+        }
+    }
+    return masks;
+}();
+
+__attribute__((target("ssse3"))) inline void spread_hex(char* out, __m128i first, __m128i second)
+{
+    for (int chunk = 0; chunk < 3; chunk++) {
+        auto a = _mm_shuffle_epi8(first, _mm_load_si128(reinterpret_cast<const __m128i*>(SPREAD.from_first[chunk])));
+        auto b = _mm_shuffle_epi8(second, _mm_load_si128(reinterpret_cast<const __m128i*>(SPREAD.from_second[chunk])));
+        auto s = _mm_load_si128(reinterpret_cast<const __m128i*>(SPREAD.spaces[chunk]));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + chunk * 16), _mm_or_si128(_mm_or_si128(a, b), s));
+    }
+}
+
+__attribute__((target("ssse3"))) char* hex_dump_ssse3(char* out, const uint8_t* data, size_t len)
+{
+    const auto digits = _mm_setr_epi8('0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'a', 'b', 'c', 'd', 'e', 'f');
+    const auto nibble = _mm_set1_epi8(0x0f);
+    for (; len >= 16; len -= 16, data += 16, out += 48) {
+        auto bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data));
+        auto high  = _mm_shuffle_epi8(digits, _mm_and_si128(_mm_srli_epi16(bytes, 4), nibble));
+        auto low   = _mm_shuffle_epi8(digits, _mm_and_si128(bytes, nibble));
+        spread_hex(out, _mm_unpacklo_epi8(high, low), _mm_unpackhi_epi8(high, low));
+    }
+    return hex_dump_scalar(out, data, len);
+}
+
+__attribute__((target("avx2"))) char* hex_dump_avx2(char* out, const uint8_t* data, size_t len)
+{
+    const auto digits = _mm256_setr_epi8('0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'a', 'b', 'c', 'd', 'e', 'f',
+                                         '0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'a', 'b', 'c', 'd', 'e', 'f');
+    const auto nibble = _mm256_set1_epi8(0x0f);
+    for (; len >= 32; len -= 32, data += 32, out += 96) {
+        auto bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data));
+        auto high  = _mm256_shuffle_epi8(digits, _mm256_and_si256(_mm256_srli_epi16(bytes, 4), nibble));
+        auto low   = _mm256_shuffle_epi8(digits, _mm256_and_si256(bytes, nibble));
+        // Unpacking works per 128 bit lane, lo holds the digits of bytes 0-7 and 16-23
+        auto lo = _mm256_unpacklo_epi8(high, low);
+        auto hi = _mm256_unpackhi_epi8(high, low);
+        spread_hex(out, _mm256_castsi256_si128(lo), _mm256_castsi256_si128(hi));
+        spread_hex(out + 48, _mm256_extracti128_si256(lo, 1), _mm256_extracti128_si256(hi, 1));
+    }
+    return hex_dump_ssse3(out, data, len);
+}
+
+detail::HexKernels supported_hex_kernels()
+{
+    detail::HexKernels kernels;
+    kernels.scalar = hex_dump_scalar;
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("ssse3")) {
+        kernels.ssse3 = hex_dump_ssse3;
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        kernels.avx2 = hex_dump_avx2;
+    }
+    return kernels;
+}
+
+#else
+
+detail::HexKernels supported_hex_kernels()
+{
+    detail::HexKernels kernels;
+    kernels.scalar = hex_dump_scalar;
+    return kernels;
+}
+
+#endif
+
+HexKernel select_hex_kernel()
+{
+    auto kernels = supported_hex_kernels();
+    return kernels.avx2 ? kernels.avx2 : kernels.ssse3 ? kernels.ssse3 : kernels.scalar;
+}
+
+}
+
+detail::HexKernels detail::hex_kernels()
+{
+    return supported_hex_kernels();
+}
+
+char* hex_dump(char* out, const uint8_t* data, size_t len)
+{
+    static const HexKernel kernel = select_hex_kernel();
+    return kernel(out, data, len);
+}
+
+void append_hex(std::string& out, const void* data, size_t len)
+{
+    if (!len) {
+        return;
+    }
+    size_t offset = out.size();
+    out.resize(offset + len * 3);
+    hex_dump(out.data() + offset, static_cast<const uint8_t*>(data), len);
+    out.pop_back();
+}
+
 }
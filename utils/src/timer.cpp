@@ -1,21 +1,93 @@
 #include "timer.hpp"
+#include "handler_allocator.hpp"
 #include "logger.hpp"
 
 #include "async_io_context.hpp"
+#include <bit>
+#include <boost/asio/use_awaitable.hpp>
+#include <cstring>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+DEFINE_LOG_CATEGORY(L_TIMER, "Timer");
 
 using namespace asio::utils;
 
+// Type erased completion handler of a pending async_wait(). Handlers of use_awaitable are
+// move-only, so std::function can't hold them
+struct Timer::Waiter {
+    virtual ~Waiter()                                          = default;
+    virtual void complete(const boost::system::error_code& ec) = 0;
+};
+
+template <typename Handler>
+struct Timer::WaiterImpl : Timer::Waiter {
+    WaiterImpl(Handler&& h, boost::asio::io_context& io) : handler(std::move(h)), io_context(io) {}
+
+    void complete(const boost::system::error_code& ec) override {
+        auto executor = boost::asio::get_associated_executor(handler, io_context.get_executor());
+        boost::asio::post(executor, [h = std::move(handler), ec]() mutable { h(ec); });
+    }
+
+    Handler handler;
+    boost::asio::io_context& io_context;
+};
+
+// Timing wheel entry of a timer using the TimerService
+struct Timer::WheelEntry final : TimerService::Entry {
+    explicit WheelEntry(Timer& t) : timer(t) {}
+
+    void expired(uint64_t generation) override {
+        // A timer being destroyed cancels the entry after its last reference is gone. The reference
+        // moves into the handler so this thread, which holds the service's lock, never drops the last
+        // one and runs ~Timer (and its cancel) under that lock
+        if (auto self = timer.weak_from_this().lock()) {
+            auto* timer_ptr = self.get();
+            timer_ptr->post([self = std::move(self), generation]() { self->wheel_callback(generation); });
+        }
+    }
+
+    Timer& timer;
+};
+
 Timer::Timer(const TimerConfig& timer_config, boost::asio::io_context& _io_context)
-    : _callback(timer_config.callback_fn),
-      _start_interval_msec(timer_config.start_interval_msec),
-      _periodic_interval_msec(timer_config.periodic_interval_msec),
-      _io_context(_io_context),
-      _strand(boost::asio::make_strand(_io_context)) {}
+    : _io_context(_io_context),
+      _scheduler(boost::asio::use_service<PriorityScheduler>(_io_context)),
+      _priority(std::make_shared<std::atomic<HandlerPriority>>(
+          timer_config.priority.value_or(HandlerPriority::LEVEL_COUNT))),
+      _strand(Executor(_io_context, _scheduler, _priority)),
+      _start_interval(timer_config.start_interval.count() ? timer_config.start_interval
+                                                           : timer_config.start_interval_msec),
+      _periodic_interval(timer_config.periodic_interval.count() ? timer_config.periodic_interval
+                                                                 : timer_config.periodic_interval_msec),
+      _high_resolution(timer_config.high_resolution),
+      _slack(timer_config.slack),
+      _periodic_mode(timer_config.periodic_mode),
+      _callback(timer_config.callback_fn)
+{
+    if (_high_resolution) {
+        int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        if (fd < 0) {
+            throw std::system_error(errno, std::generic_category(), "timerfd can't be created");
+        }
+        _timerfd = std::make_unique<boost::asio::posix::stream_descriptor>(_io_context, fd);
+    }
+    else if (timer_config.use_timer_service || _slack.count() > 0) {
+        _timer_service = &TimerService::get(_io_context);
+        _wheel_entry   = std::make_unique<WheelEntry>(*this);
+    }
+    else {
+        _timer = std::make_unique<boost::asio::steady_timer>(_io_context);
+    }
+}
 
 Timer::~Timer()
 {
-
-    stop();
+    // Every handler posted to the strand holds a reference, none of them can be pending here
+    if (_timer_service) {
+        _timer_service->cancel(*_wheel_entry);
+    }
+    complete_waiters(boost::asio::error::operation_aborted);
 }
 
 struct TimerStruct : public Timer {
@@ -31,117 +103,310 @@ std::shared_ptr<Timer> Timer::create(const TimerConfig& config,
     return std::make_shared<TimerStruct>(config, _io_context);
 }
 
-// caller must hold _mutex before calling this method
-void Timer::timer_async_wait(bool first_run)
+PriorityScheduler::executor_type Timer::Executor::current() const
 {
-    _timer->expires_after(
-        std::chrono::milliseconds(first_run ? _start_interval_msec : _periodic_interval_msec));
-    _timer->async_wait(boost::asio::bind_executor(
-        _strand, std::bind(&Timer::timer_callback, shared_from_this(), std::placeholders::_1)));
+    auto priority = _priority->load(std::memory_order_relaxed);
+    if (priority == HandlerPriority::LEVEL_COUNT) {
+        return PriorityScheduler::executor_type(*_io_context);
+    }
+    return PriorityScheduler::executor_type(*_scheduler, priority);
 }
 
-void Timer::start()
+template <typename Function>
+void Timer::post(Function&& f)
 {
-    std::lock_guard<std::recursive_mutex> lock(_mutex);
-    start_noLock();
+    boost::asio::post(_strand, with_recycling_allocator(std::forward<Function>(f)));
 }
 
-void Timer::start_noLock()
+void Timer::start()
 {
-    if (!_timer) {
-        _timer = std::make_unique<boost::asio::steady_timer>(_io_context);
+    uint64_t state = _state.load(std::memory_order_relaxed);
+    do {
+        if (state & RUNNING) {
+            return;
+        }
+    } while (!_state.compare_exchange_weak(state, state + 1, std::memory_order_acq_rel));
 
-        timer_async_wait(true);
-    }
+    post([self = shared_from_this(), state = state + 1]() { self->apply_state(state); });
 }
 
 void Timer::stop()
 {
-    std::lock_guard<std::recursive_mutex> lock(_mutex);
-    stop_no_lock();
-}
-
-void Timer::stop_no_lock()
-{
-    if (_timer) {
-        _timer->cancel();
-        _timer = nullptr;
+    uint64_t state = _state.load(std::memory_order_relaxed);
+    while ((state & RUNNING) && !_state.compare_exchange_weak(state, state + 1, std::memory_order_acq_rel)) {
     }
+
+    post([self = shared_from_this()]() {
+        self->apply_state(self->_state.load(std::memory_order_acquire));
+        self->complete_waiters(boost::asio::error::operation_aborted);
+    });
 }
 
 void Timer::restart()
 {
-    std::lock_guard<std::recursive_mutex> lock(_mutex);
-    stop_no_lock();
-    start_noLock();
+    uint64_t state = _state.load(std::memory_order_relaxed);
+    uint64_t next;
+    do {
+        next = state + ((state & RUNNING) ? 2 : 1);
+    } while (!_state.compare_exchange_weak(state, next, std::memory_order_acq_rel));
+
+    post([self = shared_from_this(), next]() { self->apply_state(next); });
 }
 
 void Timer::restart(std::function<void()> callback_fn,
                     std::chrono::milliseconds start_interval_msec,
                     std::chrono::milliseconds periodic_interval_msec)
 {
-    std::lock_guard<std::recursive_mutex> lock(_mutex);
-    stop_no_lock();
-    _callback               = callback_fn;
-    _start_interval_msec    = start_interval_msec;
-    _periodic_interval_msec = periodic_interval_msec;
-    start_noLock();
+    restart(std::move(callback_fn), std::chrono::nanoseconds(start_interval_msec),
+            std::chrono::nanoseconds(periodic_interval_msec));
+}
+
+void Timer::restart(std::function<void()> callback_fn,
+                    std::chrono::nanoseconds start_interval,
+                    std::chrono::nanoseconds periodic_interval)
+{
+    set_callback(std::move(callback_fn));
+    set_start_interval(start_interval);
+    set_periodic_interval(periodic_interval);
+    restart();
+}
+
+// Runs on _strand, brings the armed expiry in line with state
+void Timer::apply_state(uint64_t state)
+{
+    // A later control call posted its own update
+    if (_state.load(std::memory_order_acquire) != state || _armed_state == state) {
+        return;
+    }
+    disarm();
+    if (state & RUNNING) {
+        _armed_state = state;
+        timer_async_wait(true);
+    }
+}
+
+// Runs on _strand
+void Timer::disarm()
+{
+    _armed_state = 0;
+    if (_timer_service) {
+        _timer_service->cancel(*_wheel_entry);
+    } else if (_timerfd) {
+        itimerspec disarm = {};
+        timerfd_settime(_timerfd->native_handle(), 0, &disarm, nullptr);
+        _timerfd->cancel();
+    } else {
+        _timer->cancel();
+    }
 }
 
 void Timer::set_start_interval_msec(std::chrono::milliseconds msec)
 {
-    std::lock_guard<std::recursive_mutex> lock(_mutex);
-    _start_interval_msec = msec;
+    set_start_interval(msec);
 }
 
 void Timer::set_periodic_interval_msec(std::chrono::milliseconds msec)
 {
-    std::lock_guard<std::recursive_mutex> lock(_mutex);
-    _periodic_interval_msec = msec;
+    set_periodic_interval(msec);
 }
 
 std::chrono::milliseconds Timer::get_start_interval_msec() const
 {
-    std::lock_guard<std::recursive_mutex> lock(_mutex);
-    return _start_interval_msec;
+    return std::chrono::duration_cast<std::chrono::milliseconds>(get_start_interval());
 }
 
 std::chrono::milliseconds Timer::get_periodic_interval_msec() const
 {
-    std::lock_guard<std::recursive_mutex> lock(_mutex);
-    return _periodic_interval_msec;
+    return std::chrono::duration_cast<std::chrono::milliseconds>(get_periodic_interval());
+}
+
+void Timer::set_start_interval(std::chrono::nanoseconds interval)
+{
+    _start_interval.store(interval, std::memory_order_relaxed);
+}
+
+void Timer::set_periodic_interval(std::chrono::nanoseconds interval)
+{
+    _periodic_interval.store(interval, std::memory_order_relaxed);
+}
+
+std::chrono::nanoseconds Timer::get_start_interval() const
+{
+    return _start_interval.load(std::memory_order_relaxed);
+}
+
+std::chrono::nanoseconds Timer::get_periodic_interval() const
+{
+    return _periodic_interval.load(std::memory_order_relaxed);
 }
 
 void Timer::set_callback(std::function<void()> callback_fn)
 {
-    std::lock_guard<std::recursive_mutex> lock(_mutex);
-    _callback = callback_fn;
+    post([self = shared_from_this(), callback_fn = std::move(callback_fn)]() mutable {
+        self->_callback = std::move(callback_fn);
+    });
+}
+
+void Timer::set_priority(HandlerPriority priority)
+{
+    _priority->store(priority, std::memory_order_relaxed);
+}
+
+// Runs on _strand
+void Timer::timer_async_wait(bool first_run)
+{
+    auto now    = std::chrono::steady_clock::now();
+    auto period = _periodic_interval.load(std::memory_order_relaxed);
+    if (first_run || _periodic_mode == PeriodicMode::RELATIVE) {
+        _deadline = now + (first_run ? _start_interval.load(std::memory_order_relaxed) : period);
+    }
+    else {
+        // Deadlines stay on the grid of the first expiry, however long the callback took
+        _deadline += period;
+        if (_periodic_mode == PeriodicMode::SKIP && _deadline < now) {
+            auto missed = (now - _deadline) / period + 1;
+            _deadline += missed * period;
+            _skipped_deadlines.fetch_add(missed, std::memory_order_relaxed);
+        }
+    }
+
+    if (_timer_service) {
+        _timer_service->schedule(*_wheel_entry, _deadline - now, _slack);
+        return;
+    }
+    if (_timerfd) {
+        timerfd_wait();
+        return;
+    }
+    _timer->expires_at(_deadline);
+    _timer->async_wait(boost::asio::bind_executor(
+        _strand, with_recycling_allocator(
+                     [self = shared_from_this(), state = _armed_state](const boost::system::error_code& ec) {
+                         self->timer_callback(ec, state);
+                     })));
 }
 
-void Timer::timer_callback(const std::error_code& ec)
+void Timer::timer_callback(const boost::system::error_code& ec, uint64_t state)
 {
-    std::lock_guard<std::recursive_mutex> lock(_mutex);
     if (ec) {
         if (ec.value() == boost::asio::error::operation_aborted) {
-            LOG_ERROR(L_ASIOUTIL, "In {} operation aborted..{} {}", __func__, ec.value(), ec.message());
+            LOG_ERROR(L_TIMER, "In {} operation aborted..{} {}", __func__, ec.value(), ec.message());
             return;
         }
-        else {
-            LOG_ERROR(L_ASIOUTIL, "timer_callback error {} {}", ec.value(), ec.message());
-        }
+        LOG_ERROR(L_TIMER, "timer_callback error {} {}", ec.value(), ec.message());
     }
-    if (_timer) {
-        call_callback();
-        
-        if (_periodic_interval_msec > std::chrono::milliseconds(0) && _timer) {
-            timer_async_wait(false);
-        }
-        else {
-            _timer = nullptr;
-        }
+    on_expiry(state);
+}
+
+// Runs on _strand
+void Timer::on_expiry(uint64_t state)
+{
+    // Stopped or restarted after this expiry was armed
+    if (state != _armed_state || _state.load(std::memory_order_acquire) != state) {
+        LOG_TRACE(L_TIMER, "Timer was stopped");
+        return;
+    }
+
+    record_lateness(std::chrono::steady_clock::now());
+    call_callback();
+    complete_waiters({});
+
+    // The callback may have stopped or restarted the timer, the update it posted takes over
+    if (_state.load(std::memory_order_acquire) != state || _armed_state != state) {
+        return;
+    }
+    if (_periodic_interval.load(std::memory_order_relaxed) > std::chrono::nanoseconds(0)) {
+        timer_async_wait(false);
     }
     else {
-        LOG_TRACE(L_ASIOUTIL, "Timer was stopped");
+        _armed_state = 0;
+        _state.compare_exchange_strong(state, state + 1, std::memory_order_acq_rel);
+    }
+}
+
+// Runs on _strand
+void Timer::timerfd_wait()
+{
+    // steady_clock is CLOCK_MONOTONIC, the deadline can be handed to the kernel as it is
+    auto since_epoch = _deadline.time_since_epoch();
+    auto sec         = std::chrono::duration_cast<std::chrono::seconds>(since_epoch);
+    itimerspec spec  = {};
+    spec.it_value.tv_sec  = sec.count();
+    spec.it_value.tv_nsec = std::chrono::duration_cast<std::chrono::nanoseconds>(since_epoch - sec).count();
+    if (timerfd_settime(_timerfd->native_handle(), TFD_TIMER_ABSTIME, &spec, nullptr) < 0) {
+        LOG_ERROR(L_TIMER, "[{}] timerfd_settime failed {}", __func__, strerror(errno));
+    }
+
+    _timerfd->async_wait(boost::asio::posix::stream_descriptor::wait_read,
+                         boost::asio::bind_executor(_strand, with_recycling_allocator(
+                                                                 [self = shared_from_this(), state = _armed_state](
+                                                                     const boost::system::error_code& ec) {
+                                                                     self->timerfd_callback(ec, state);
+                                                                 })));
+}
+
+void Timer::timerfd_callback(const boost::system::error_code& ec, uint64_t state)
+{
+    if (ec || state != _armed_state) {
+        timer_callback(ec, state);
+        return;
+    }
+
+    uint64_t expirations = 0;
+    if (read(_timerfd->native_handle(), &expirations, sizeof(expirations)) < 0) {
+        // Woken before the deadline, wait for it again
+        timerfd_wait();
+        return;
+    }
+    on_expiry(state);
+}
+
+void Timer::wheel_callback(uint64_t generation)
+{
+    // Cancelled or rescheduled after this expiry was posted
+    if (generation != _wheel_entry->generation()) {
+        return;
+    }
+    on_expiry(_armed_state);
+}
+
+// Runs on _strand
+void Timer::record_lateness(std::chrono::steady_clock::time_point now)
+{
+    auto lateness = std::max(now - _deadline, std::chrono::steady_clock::duration::zero());
+    auto nsec     = std::chrono::duration_cast<std::chrono::nanoseconds>(lateness).count();
+    auto usec     = std::chrono::duration_cast<std::chrono::microseconds>(lateness).count();
+    size_t bucket = std::min<size_t>(std::bit_width(static_cast<uint64_t>(usec)), TimerStats::JITTER_BUCKETS - 1);
+
+    _expirations.fetch_add(1, std::memory_order_relaxed);
+    _jitter_histogram[bucket].fetch_add(1, std::memory_order_relaxed);
+    _total_lateness_ns.fetch_add(nsec, std::memory_order_relaxed);
+    if (nsec > _max_lateness_ns.load(std::memory_order_relaxed)) {
+        _max_lateness_ns.store(nsec, std::memory_order_relaxed);
+    }
+}
+
+TimerStats Timer::stats() const
+{
+    TimerStats stats;
+    stats.expirations       = _expirations.load(std::memory_order_relaxed);
+    stats.skipped_deadlines = _skipped_deadlines.load(std::memory_order_relaxed);
+    stats.total_lateness    = std::chrono::nanoseconds(_total_lateness_ns.load(std::memory_order_relaxed));
+    stats.max_lateness      = std::chrono::nanoseconds(_max_lateness_ns.load(std::memory_order_relaxed));
+    for (size_t i = 0; i < TimerStats::JITTER_BUCKETS; i++) {
+        stats.jitter_histogram[i] = _jitter_histogram[i].load(std::memory_order_relaxed);
+    }
+    return stats;
+}
+
+void Timer::reset_stats()
+{
+    _expirations.store(0, std::memory_order_relaxed);
+    _skipped_deadlines.store(0, std::memory_order_relaxed);
+    _total_lateness_ns.store(0, std::memory_order_relaxed);
+    _max_lateness_ns.store(0, std::memory_order_relaxed);
+    for (auto& bucket : _jitter_histogram) {
+        bucket.store(0, std::memory_order_relaxed);
     }
 }
 
@@ -151,15 +416,33 @@ void Timer::call_callback()
         _callback();
     }
     else {
-        LOG_WARN(L_ASIOUTIL, "Undefined callback");
+        LOG_WARN(L_TIMER, "Undefined callback");
     }
 }
 
-bool Timer::is_started()
+boost::asio::awaitable<void> Timer::async_wait()
+{
+    co_await boost::asio::async_initiate<decltype(boost::asio::use_awaitable), void(boost::system::error_code)>(
+        [this](auto handler) {
+            auto waiter = std::make_unique<WaiterImpl<decltype(handler)>>(std::move(handler), _io_context);
+            post([self = shared_from_this(), waiter = std::move(waiter)]() mutable {
+                self->_waiters.push_back(std::move(waiter));
+                self->start();
+            });
+        },
+        boost::asio::use_awaitable);
+}
+
+// Runs on _strand
+void Timer::complete_waiters(const boost::system::error_code& ec)
 {
-    std::lock_guard<std::recursive_mutex> lock(_mutex);
-    if (_timer) {
-        return true;
+    for (auto& waiter : _waiters) {
+        waiter->complete(ec);
     }
-    return false;
+    _waiters.clear();
+}
+
+bool Timer::is_started()
+{
+    return _state.load(std::memory_order_acquire) & RUNNING;
 }
@@ -0,0 +1,222 @@
+#include "timer_service.hpp"
+#include "handler_allocator.hpp"
+#include "logger.hpp"
+
+#include <bit>
+
+using namespace asio::utils;
+
+boost::asio::execution_context::id TimerService::id;
+
+TimerService::TimerService(boost::asio::io_context& io_ctx)
+    : boost::asio::execution_context::service(io_ctx),
+      _timer(io_ctx),
+      _epoch(std::chrono::steady_clock::now()) {}
+
+TimerService& TimerService::get(boost::asio::io_context& io_ctx)
+{
+    return boost::asio::use_service<TimerService>(io_ctx);
+}
+
+void TimerService::shutdown()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (auto& level : _slots) {
+        for (auto& slot : level) {
+            while (slot) {
+                unlink(*slot);
+            }
+        }
+    }
+    _size = 0;
+    _timer.cancel();
+}
+
+void TimerService::schedule(Entry& entry, std::chrono::steady_clock::duration delay,
+                            std::chrono::steady_clock::duration slack)
+{
+    auto now = std::chrono::steady_clock::now();
+    std::lock_guard<std::mutex> lock(_mutex);
+    advance(tick_of(now));
+    if (entry._slot) {
+        unlink(entry);
+    } else {
+        _size++;
+    }
+
+    // Round up, an entry never expires early
+    auto expiry        = now + std::max(delay, std::chrono::steady_clock::duration::zero()) - _epoch;
+    uint64_t ticks     = (expiry + TICK - std::chrono::steady_clock::duration(1)) / TICK;
+    entry._expiry_tick = std::max(ticks, _current_tick + 1);
+
+    uint64_t slack_ticks = std::max(slack, std::chrono::steady_clock::duration::zero()) / TICK;
+    if (slack_ticks) {
+        uint64_t latest = entry._expiry_tick + slack_ticks;
+        if (_armed_tick >= entry._expiry_tick && _armed_tick <= latest) {
+            entry._expiry_tick = _armed_tick;
+        } else {
+            // Latest tick of the window on a power of two grid no coarser than the slack
+            uint64_t grid      = std::bit_floor(slack_ticks + 1);
+            entry._expiry_tick = latest / grid * grid;
+        }
+    }
+    entry._generation.fetch_add(1, std::memory_order_release);
+    link(entry);
+    arm();
+}
+
+void TimerService::cancel(Entry& entry)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    entry._generation.fetch_add(1, std::memory_order_release);
+    if (entry._slot) {
+        unlink(entry);
+        _size--;
+    }
+}
+
+size_t TimerService::size() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _size;
+}
+
+uint64_t TimerService::wakeups_saved() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _expired_entries - _expired_ticks;
+}
+
+uint64_t TimerService::tick_of(std::chrono::steady_clock::time_point time) const
+{
+    return (time - _epoch) / TICK;
+}
+
+// caller must hold _mutex before calling the methods below
+void TimerService::link(Entry& entry)
+{
+    constexpr uint64_t max_delta = (uint64_t(1) << (LEVEL_BITS * LEVELS)) - 1;
+
+    // Entries further out than the wheel reaches wait in the last level and move down later
+    uint64_t delta = std::min(entry._expiry_tick - _current_tick, max_delta);
+    size_t level   = 0;
+    while (level < LEVELS - 1 && delta >= (uint64_t(1) << (LEVEL_BITS * (level + 1)))) {
+        level++;
+    }
+    size_t index = ((_current_tick + delta) >> (LEVEL_BITS * level)) & (SLOTS - 1);
+
+    Entry*& head = _slots[level][index];
+    entry._prev  = nullptr;
+    entry._next  = head;
+    entry._slot  = &head;
+    if (head) {
+        head->_prev = &entry;
+    }
+    head = &entry;
+    _occupied[level] |= uint64_t(1) << index;
+}
+
+void TimerService::unlink(Entry& entry)
+{
+    if (entry._prev) {
+        entry._prev->_next = entry._next;
+    } else {
+        *entry._slot = entry._next;
+        if (!entry._next) {
+            // Recover level and slot from the position of the list head
+            auto offset = entry._slot - &_slots[0][0];
+            _occupied[offset / SLOTS] &= ~(uint64_t(1) << (offset % SLOTS));
+        }
+    }
+    if (entry._next) {
+        entry._next->_prev = entry._prev;
+    }
+    entry._prev = entry._next = nullptr;
+    entry._slot               = nullptr;
+}
+
+// First tick after _current_tick that expires entries or moves them down a level
+uint64_t TimerService::next_event() const
+{
+    uint64_t next = UINT64_MAX;
+    for (size_t level = 0; level < LEVELS; level++) {
+        if (!_occupied[level]) {
+            continue;
+        }
+        uint64_t base  = _current_tick >> (LEVEL_BITS * level);
+        uint64_t first = std::countr_zero(std::rotr(_occupied[level], static_cast<int>((base + 1) % SLOTS)));
+        next           = std::min(next, (base + 1 + first) << (LEVEL_BITS * level));
+    }
+    return next;
+}
+
+void TimerService::advance(uint64_t tick)
+{
+    while (_current_tick < tick) {
+        uint64_t next = next_event();
+        if (next > tick) {
+            _current_tick = tick;
+            break;
+        }
+        _current_tick = next;
+
+        for (size_t level = 1; level < LEVELS; level++) {
+            if (_current_tick & ((uint64_t(1) << (LEVEL_BITS * level)) - 1)) {
+                break;
+            }
+            cascade(level);
+        }
+
+        Entry*& slot = _slots[0][_current_tick & (SLOTS - 1)];
+        _expired_ticks += slot != nullptr;
+        while (Entry* entry = slot) {
+            _expired_entries++;
+            unlink(*entry);
+            _size--;
+            entry->expired(entry->_generation.load(std::memory_order_relaxed));
+        }
+    }
+}
+
+void TimerService::cascade(size_t level)
+{
+    size_t index = (_current_tick >> (LEVEL_BITS * level)) & (SLOTS - 1);
+    Entry* entry = _slots[level][index];
+    _slots[level][index] = nullptr;
+    _occupied[level] &= ~(uint64_t(1) << index);
+
+    while (entry) {
+        Entry* next = entry->_next;
+        link(*entry);
+        entry = next;
+    }
+}
+
+void TimerService::arm()
+{
+    uint64_t next = next_event();
+    if (next == UINT64_MAX || next == _armed_tick) {
+        return;
+    }
+
+    // Re-arming cancels the wait in flight, its handler sees operation_aborted
+    _armed_tick = next;
+    _timer.expires_at(_epoch + next * TICK);
+    _timer.async_wait(with_recycling_allocator([this](const boost::system::error_code& ec) { on_timer(ec); }));
+}
+
+void TimerService::on_timer(const boost::system::error_code& ec)
+{
+    if (ec == boost::asio::error::operation_aborted) {
+        return;
+    }
+    if (ec) {
+        LOG_ERROR(L_TIMER, "[{}] Timing wheel wait failed {} {}", __func__, ec.value(), ec.message());
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    std::lock_guard<std::mutex> lock(_mutex);
+    _armed_tick = 0;
+    advance(tick_of(now));
+    arm();
+}
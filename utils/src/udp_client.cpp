@@ -1,14 +1,20 @@
 #include "udp_client.hpp"
+#include "handler_allocator.hpp"
 #include "logger.hpp"
 #include <boost/asio.hpp>
+#include <boost/asio/use_awaitable.hpp>
 #include <functional>
 #include <map>
 #include <vector>
 
+DEFINE_LOG_CATEGORY(L_UDP, "UDP");
+
 namespace asio::utils {
 
 // Initial receive message buffer size
 static constexpr size_t INIT_MESSAGE_SIZE = 1024;
+// Trace hex dumps of received datagrams, the rest of a burst is skipped
+static constexpr uint32_t RX_HEX_DUMPS_PER_SECOND = 20;
 
 /**
  * UDP client implementation.
@@ -19,7 +25,14 @@ public:
     ~UdpClientImpl();
     int async_send(const void* data, size_t size, data_handler_t&& handler = nullptr);
     int register_callback(const char* id, callback_t&& callback);
+    int register_timestamped_callback(const char* id, timestamped_callback_t&& callback);
     int unregister_callback(const char* id);
+    int enable_rx_timestamps(bool hardware);
+    RxLatencyStats rx_latency_stats() const;
+    void reset_rx_latency_stats();
+    boost::asio::awaitable<size_t> async_receive(boost::asio::mutable_buffer buffer);
+    int set_busy_poll(std::chrono::microseconds budget);
+    void set_priority(HandlerPriority priority);
 
 private:
     void receive_handler(const boost::system::error_code& error, size_t bytes_transferred);
@@ -32,9 +45,13 @@ private:
     boost::asio::ip::udp::endpoint _receive_endpoint;
     boost::asio::ip::udp::endpoint _send_endpoint;
     boost::asio::ip::udp::socket _socket;
+    PriorityScheduler::executor_type _executor;
 
-    std::map<std::string, callback_t> _callbacks;
+    std::map<std::string, timestamped_callback_t> _callbacks;
     std::vector<char> _rcv_buf;
+    bool _receiving = false;
+    RxTimestampControl _rcv_control;
+    RxLatencyRecorder _rx_latency;
 };
 
 UdpClientImpl::UdpClientImpl(boost::asio::io_context& io, const std::string& addr, uint16_t receive_port,
@@ -46,20 +63,19 @@ UdpClientImpl::UdpClientImpl(boost::asio::io_context& io, const std::string& add
       _receive_endpoint(*_resolver.resolve(boost::asio::ip::udp::v4(), addr, _receive_port.c_str()).begin()),
       _send_endpoint(*_resolver.resolve(boost::asio::ip::udp::v4(), addr, _send_port.c_str()).begin()),
       _socket(io, _receive_endpoint),
+      _executor(io),
       _rcv_buf(INIT_MESSAGE_SIZE) {
     boost::system::error_code ec;
     auto address = boost::asio::ip::make_address(addr, ec);
     if (ec) {
-        LOG_ERROR(L_ASIOUTIL, "[{}] Malformed UDP server address: {}", __func__, addr);
+        LOG_ERROR(L_UDP, "[{}] Malformed UDP server address: {}", __func__, addr);
         boost::asio::detail::throw_error(ec);
     }
 
     std::stringstream printable_endpoint;
     printable_endpoint << _receive_endpoint;
 
-    LOG_INFO(L_ASIOUTIL, "[{}] UDP Client Created: Listening on {}", __func__, printable_endpoint.str());
-
-    receive_loop();
+    LOG_INFO(L_UDP, "[{}] UDP Client Created: Listening on {}", __func__, printable_endpoint.str());
 }
 
 UdpClientImpl::~UdpClientImpl() {
@@ -70,26 +86,43 @@ UdpClientImpl::~UdpClientImpl() {
 int UdpClientImpl::async_send(const void* data, size_t size, data_handler_t&& handler) {
 
     if (data == nullptr) {
-        LOG_ERROR(L_ASIOUTIL, "[{}] An attempt to send null data pointer", __func__);
+        LOG_ERROR(L_UDP, "[{}] An attempt to send null data pointer", __func__);
         return EINVAL;
     }
     if (handler == nullptr) {
         handler = [&](const boost::system::error_code& error, size_t bytes_transferred) {
-            LOG_TRACE(L_ASIOUTIL, "[{}] Stub send handler executed", __func__);
+            LOG_TRACE(L_UDP, "[{}] Stub send handler executed", __func__);
         };
     }
 
     _socket.async_send_to(boost::asio::const_buffer(data, size), _send_endpoint,
-                          std::bind(&UdpClientImpl::handle_send, this, std::placeholders::_1, std::placeholders::_2));
+                          boost::asio::bind_executor(_executor, with_recycling_allocator([this](auto error, auto bt) {
+                                                         handle_send(error, bt);
+                                                     })));
     return 0;
 }
 
 int UdpClientImpl::register_callback(const char* id, callback_t&& callback) {
     if (callback == nullptr) {
-        LOG_ERROR(L_ASIOUTIL, "Callback pointer cannot be nullptr");
+        LOG_ERROR(L_UDP, "Callback pointer cannot be nullptr");
+        return EINVAL;
+    }
+    return register_timestamped_callback(
+        id, [callback = std::move(callback)](std::vector<char>& data, size_t size, const RxTimestamp&) {
+            callback(data, size);
+        });
+}
+
+int UdpClientImpl::register_timestamped_callback(const char* id, timestamped_callback_t&& callback) {
+    if (callback == nullptr) {
+        LOG_ERROR(L_UDP, "Callback pointer cannot be nullptr");
         return EINVAL;
     }
     const auto [_, success] = _callbacks.insert({id, callback});
+    if (!_receiving) {
+        _receiving = true;
+        receive_loop();
+    }
 
     // Convert bool to int return (true -> 0, false -> 1)
     return (int)!success;
@@ -100,9 +133,44 @@ int UdpClientImpl::unregister_callback(const char* id) {
     return ret == 1 ? 0 : ENOENT;
 }
 
+boost::asio::awaitable<size_t> UdpClientImpl::async_receive(boost::asio::mutable_buffer buffer) {
+    boost::asio::ip::udp::endpoint sender;
+    co_return co_await _socket.async_receive_from(buffer, sender, boost::asio::use_awaitable);
+}
+
+int UdpClientImpl::enable_rx_timestamps(bool hardware) {
+    int err = asio::utils::enable_rx_timestamps(_socket.native_handle(), hardware);
+    if (err) {
+        LOG_WARN(L_UDP, "[{}] Receive timestamps can't be enabled: {}", __func__, strerror(err));
+    }
+    return err;
+}
+
+RxLatencyStats UdpClientImpl::rx_latency_stats() const {
+    return _rx_latency.stats();
+}
+
+void UdpClientImpl::reset_rx_latency_stats() {
+    _rx_latency.reset();
+}
+
+int UdpClientImpl::set_busy_poll(std::chrono::microseconds budget) {
+    int usec = static_cast<int>(budget.count());
+    if (setsockopt(_socket.native_handle(), SOL_SOCKET, SO_BUSY_POLL, &usec, sizeof(usec)) < 0) {
+        int err = errno;
+        LOG_WARN(L_UDP, "[{}] SO_BUSY_POLL {}us can't be set: {}", __func__, usec, strerror(err));
+        return err;
+    }
+    return 0;
+}
+
+void UdpClientImpl::set_priority(HandlerPriority priority) {
+    _executor = PriorityScheduler::executor(_io, priority);
+}
+
 void UdpClientImpl::handle_send(const boost::system::error_code& error, std::size_t bytes_transferred) {
     if (error) {
-        LOG_ERROR(L_ASIOUTIL, "Send error: {}", error.message());
+        LOG_ERROR(L_UDP, "Send error: {}", error.message());
     }
 }
 
@@ -112,38 +180,55 @@ void UdpClientImpl::receive_handler(const boost::system::error_code& error, size
     }
 
     if (error) {
-        LOG_ERROR(L_ASIOUTIL, "[{}] Socket read error: {} ({})", __func__, error.message(), bytes_transferred);
+        LOG_ERROR(L_UDP, "[{}] Socket read error: {} ({})", __func__, error.message(), bytes_transferred);
     } else if (bytes_transferred == 0) {
-        LOG_ERROR(L_ASIOUTIL, "[{}] Unexpected empty message received (not in the protocol)", __func__);
+        LOG_ERROR(L_UDP, "[{}] Unexpected empty message received (not in the protocol)", __func__);
     } else if (bytes_transferred > MAX_MESSAGE_SIZE) {
-        LOG_ERROR(L_ASIOUTIL, "[{}] Too big message of size {} received. Dropping", __func__, bytes_transferred);
+        LOG_ERROR(L_UDP, "[{}] Too big message of size {} received. Dropping", __func__, bytes_transferred);
     } else {
         boost::system::error_code ec = {};
         // We'd write data directly to the underlying array, set the actual size first
         _rcv_buf.resize(bytes_transferred);
-        auto bytes_read = _socket.receive(boost::asio::buffer(_rcv_buf.data(), bytes_transferred), 0, ec);
+        // recvmsg rather than receive() for the timestamp in the ancillary data
+        iovec iov          = {_rcv_buf.data(), bytes_transferred};
+        msghdr msg         = {};
+        msg.msg_iov        = &iov;
+        msg.msg_iovlen     = 1;
+        msg.msg_control    = _rcv_control.data;
+        msg.msg_controllen = sizeof(_rcv_control.data);
+        ssize_t received   = ::recvmsg(_socket.native_handle(), &msg, 0);
+        size_t bytes_read  = 0;
+        RxTimestamp timestamp;
+        if (received < 0) {
+            ec = boost::system::error_code(errno, boost::system::system_category());
+        } else {
+            bytes_read = static_cast<size_t>(received);
+            timestamp  = parse_rx_timestamp(msg);
+        }
         if (ec) {
-            LOG_ERROR(L_ASIOUTIL, "[{}] Socket read error: {} ({})", __func__, ec.message(), bytes_read);
+            LOG_ERROR(L_UDP, "[{}] Socket read error: {} ({})", __func__, ec.message(), bytes_read);
         } else if (bytes_read == 0) {
-            LOG_ERROR(L_ASIOUTIL, "[{}] Unexpected empty message received (not in the protocol)", __func__);
+            LOG_ERROR(L_UDP, "[{}] Unexpected empty message received (not in the protocol)", __func__);
         } else if (_callbacks.empty()) {
-            LOG_DEBUG(L_ASIOUTIL, "[{}] No callback registered. Dropping message", __func__);
+            LOG_DEBUG(L_UDP, "[{}] No callback registered. Dropping message", __func__);
         } else {
             if (bytes_read != bytes_transferred) {
-                LOG_ERROR(L_ASIOUTIL,
+                LOG_ERROR(L_UDP,
                           " [{}] Unexpected condition! Read data size differs from the lookup result. "
                           "({} != {})",
                           __func__, bytes_read, bytes_transferred);
             }
             // Process the received data with the registered callbacks
-            LOG_HEX(L_ASIOUTIL, asio::logger::LogLevel::TRACE, "Received message data", _rcv_buf.data(), bytes_read);
+            LOG_HEX_RATE_LIMITED(RX_HEX_DUMPS_PER_SECOND, L_UDP, asio::logger::LogLevel::TRACE, "Received message data",
+                                 _rcv_buf.data(), bytes_read);
+            _rx_latency.record(timestamp);
             for (const auto& [key, callback] : _callbacks) {
                 // Callbacks are coming from outside, so guard the main loop
                 try {
-                    callback(_rcv_buf, bytes_read);
+                    callback(_rcv_buf, bytes_read, timestamp);
 
                 } catch (std::exception& ex) {
-                    LOG_ERROR(L_ASIOUTIL, "[{}] Callback \"{}\" threw an exception! {}", __func__, key, ex.what());
+                    LOG_ERROR(L_UDP, "[{}] Callback \"{}\" threw an exception! {}", __func__, key, ex.what());
                 }
             }
         }
@@ -156,7 +241,9 @@ void UdpClientImpl::receive_loop() {
 
     _socket.async_receive_from(
         boost::asio::buffer(_rcv_buf), _receive_endpoint, MSG_PEEK | MSG_TRUNC,
-        std::bind(&UdpClientImpl::receive_handler, this, std::placeholders::_1, std::placeholders::_2));
+        boost::asio::bind_executor(_executor, with_recycling_allocator([this](auto error, auto bt) {
+                                       receive_handler(error, bt);
+                                   })));
 }
 
 std::unique_ptr<UdpClient> UdpClient::create(boost::asio::io_context& io, const std::string& addr,